@@ -0,0 +1,97 @@
+#include "logging.h"
+#include "stream_compressor.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+using namespace log;
+
+// 以 demo/main.cpp 的日志内容为样本，按后端线程每轮一块 4MB 的方式
+// 流式压缩，统计每秒处理的原始日志字节数与压缩比，并解压核对
+
+constexpr size_t kBatchSize = 4000 * 1000;
+constexpr int kLines = 1000000;
+
+std::string g_text;
+
+void memoryOutput(const char *msg, int len) { g_text.append(msg, len); }
+
+// 依次解压首尾相接的 gzip member
+std::string gunzip(const std::string &data) {
+  std::string out;
+  z_stream stream = {};
+  inflateInit2(&stream, 15 + 32);
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  char buf[256 * 1024];
+  while (stream.avail_in > 0) {
+    stream.next_out = reinterpret_cast<Bytef *>(buf);
+    stream.avail_out = sizeof buf;
+    int ret = inflate(&stream, Z_NO_FLUSH);
+    out.append(buf, sizeof buf - stream.avail_out);
+    if (ret == Z_STREAM_END) {
+      inflateReset(&stream);
+    } else if (ret != Z_OK) {
+      break;
+    }
+  }
+  inflateEnd(&stream);
+  return out;
+}
+
+void bench(const char *name, const std::string &text, int level) {
+  std::string compressed;
+  compressed.reserve(text.size());
+  StreamCompressor compressor(level, [&compressed](const char *data,
+                                                   size_t len) {
+    compressed.append(data, len);
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t pos = 0; pos < text.size(); pos += kBatchSize) {
+    size_t len = std::min(kBatchSize, text.size() - pos);
+    compressor.compress(text.data() + pos, len);
+    // 后端线程每轮写入后 flush，即结束一个 member
+    compressor.finish();
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+
+  bool ok = gunzip(compressed) == text;
+  printf("%-16s level %d: %7.1f MB/s  %6.1f MB -> %5.1f MB  ratio %5.2f  %s\n",
+         name, level, text.size() / seconds / 1e6, text.size() / 1e6,
+         compressed.size() / 1e6,
+         static_cast<double>(text.size()) / compressed.size(),
+         ok ? "round-trip ok" : "ROUND-TRIP MISMATCH");
+}
+
+int main() {
+  setOutput(memoryOutput);
+  std::string empty = " ";
+  std::string longStr(3000, 'X');
+  longStr += " ";
+
+  g_text.reserve(kLines * 100);
+  for (int i = 0; i < kLines; ++i) {
+    LOG_INFO << "Hello 0123456789"
+             << " abcdefghijklmnopqrstuvwxyz " << empty << i;
+  }
+  std::string shortLines;
+  shortLines.swap(g_text);
+
+  g_text.reserve(kLines / 10 * 3100);
+  for (int i = 0; i < kLines / 10; ++i) {
+    LOG_INFO << "Hello 0123456789"
+             << " abcdefghijklmnopqrstuvwxyz " << longStr << i;
+  }
+  std::string longLines;
+  longLines.swap(g_text);
+
+  for (int level : {1, 3, 6}) {
+    bench("demo", shortLines, level);
+    bench("demo -l", longLines, level);
+  }
+}
@@ -0,0 +1,102 @@
+#include "log_stream.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace log;
+
+// 对比 LogStream::operator<<(double) 与原先的 snprintf("%.12g")；
+// 输出的正确性见 check/check_double_format.cpp
+// 注意: namespace log 与 <cmath> 中的 log() 冲突，这里不使用 <cmath>/<random>
+
+// xorshift64*
+struct Rng {
+  uint64_t state = 20240603;
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+  }
+  // [0, 1)
+  double uniform() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+};
+
+bool isFinite(double v) {
+  uint64_t u;
+  memcpy(&u, &v, sizeof u);
+  return (u & 0x7FF0000000000000ULL) != 0x7FF0000000000000ULL;
+}
+
+constexpr int kIterations = 2000000;
+
+// 防止被优化掉
+volatile size_t g_sink;
+
+template <typename Func>
+double nsPerOp(const std::vector<double> &values, Func &&func) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    func(values[i % values.size()]);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         kIterations;
+}
+
+void bench(const char *name, const std::vector<double> &values) {
+  LogStream stream;
+  double logStream = nsPerOp(values, [&stream](double v) {
+    if (stream.buffer().avail() < 64) {
+      stream.resetBuffer();
+    }
+    stream << v;
+  });
+
+  g_sink = stream.buffer().length();
+
+  char buf[64];
+  double snprintfNs = nsPerOp(values, [&buf](double v) {
+    g_sink = snprintf(buf, sizeof buf, "%.12g", v);
+  });
+
+  printf("%-12s LogStream: %6.1f ns/op  snprintf(%%.12g): %6.1f ns/op  "
+         "(%.2fx)\n",
+         name, logStream, snprintfNs, snprintfNs / logStream);
+}
+
+int main() {
+  Rng rng;
+  const size_t kCount = 1 << 16;
+
+  // 任意位模式（排除 NaN/Inf）
+  std::vector<double> bits;
+  while (bits.size() < kCount) {
+    uint64_t u = rng.next();
+    double v;
+    memcpy(&v, &u, sizeof v);
+    if (isFinite(v)) {
+      bits.push_back(v);
+    }
+  }
+
+  // 典型的指标数据: 精确到微秒的毫秒级延迟、比率
+  std::vector<double> metrics;
+  while (metrics.size() < kCount) {
+    metrics.push_back(static_cast<int64_t>(rng.uniform() * 1000000) / 1000.0);
+    metrics.push_back(rng.uniform());
+  }
+
+  // 整数值
+  std::vector<double> integers;
+  while (integers.size() < kCount) {
+    integers.push_back(static_cast<double>(rng.next() % 1000001));
+  }
+
+  bench("random bits", bits);
+  bench("metrics", metrics);
+  bench("integers", integers);
+  return 0;
+}
@@ -0,0 +1,147 @@
+#include "log_stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using namespace log;
+
+// 对比 LogStream 的整数格式化与原先逐位除法 + std::reverse 的实现，
+// 分别使用均匀分布的 64 位随机数和日志中常见的小整数（ID、计数器），
+// 并与 snprintf 的结果逐一比对
+
+constexpr int kIterations = 5000000;
+
+// 防止被优化掉
+volatile size_t g_sink;
+
+// 原实现: Efficient Integer to String Conversions, by Matthew Wilson.
+const char digits[] = "9876543210123456789";
+const char *zero = digits + 9;
+
+template <typename T> size_t oldConvert(char buf[], T value) {
+  T i = value;
+  char *p = buf;
+
+  do {
+    int lsd = static_cast<int>(i % 10);
+    i /= 10;
+    *p++ = zero[lsd];
+  } while (i != 0);
+
+  if (value < 0) {
+    *p++ = '-';
+  }
+  *p = '\0';
+  std::reverse(buf, p);
+
+  return p - buf;
+}
+
+// xorshift64*
+struct Rng {
+  uint64_t state = 20240603;
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+  }
+};
+
+template <typename T, typename Func>
+double nsPerOp(const std::vector<T> &values, Func &&func) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    func(values[i % values.size()]);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         kIterations;
+}
+
+template <typename T>
+void bench(const char *name, const std::vector<T> &values) {
+  LogStream stream;
+  double current = nsPerOp(values, [&stream](T v) {
+    if (stream.buffer().avail() < 64) {
+      stream.resetBuffer();
+    }
+    stream << v;
+  });
+  g_sink = stream.buffer().length();
+
+  char buf[64];
+  double old = nsPerOp(values, [&buf](T v) { g_sink = oldConvert(buf, v); });
+
+  printf("%-24s LogStream: %5.1f ns/op  old: %5.1f ns/op  (%.2fx)\n", name,
+         current, old, old / current);
+}
+
+template <typename T> T printable(T v) { return v; }
+uintptr_t printable(const void *p) { return reinterpret_cast<uintptr_t>(p); }
+
+template <typename T>
+bool verify(const std::vector<T> &values, const char *format) {
+  LogStream stream;
+  char expected[64];
+  for (T v : values) {
+    stream.resetBuffer();
+    stream << v;
+    snprintf(expected, sizeof expected, format, printable(v));
+    if (stream.buffer().toString() != expected) {
+      fprintf(stderr, "mismatch: %s vs %s\n",
+              stream.buffer().toString().c_str(), expected);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  Rng rng;
+  const size_t kCount = 1 << 16;
+
+  std::vector<int> smallInts;
+  std::vector<int> randomInts;
+  std::vector<long> randomLongs;
+  std::vector<unsigned long long> randomU64;
+  std::vector<const void *> pointers;
+  for (size_t i = 0; i < kCount; ++i) {
+    uint64_t r = rng.next();
+    smallInts.push_back(static_cast<int>(r % 1000));
+    randomInts.push_back(static_cast<int>(r));
+    randomLongs.push_back(static_cast<long>(rng.next()));
+    randomU64.push_back(rng.next());
+    pointers.push_back(
+        reinterpret_cast<const void *>(r & 0x00007FFFFFFFFFFFULL));
+  }
+
+  bench("int [0, 1000)", smallInts);
+  bench("int (random)", randomInts);
+  bench("long (random)", randomLongs);
+  bench("unsigned long long", randomU64);
+
+  {
+    LogStream stream;
+    double ns = nsPerOp(pointers, [&stream](const void *p) {
+      if (stream.buffer().avail() < 64) {
+        stream.resetBuffer();
+      }
+      stream << p;
+    });
+    g_sink = stream.buffer().length();
+    printf("%-24s LogStream: %5.1f ns/op\n", "pointer", ns);
+  }
+
+  std::vector<long> edges = {0, 1, -1, 9, 10, 99, 100, -100, INT64_MAX,
+                             INT64_MIN};
+  bool ok = verify(smallInts, "%d") && verify(randomInts, "%d") &&
+            verify(randomLongs, "%ld") && verify(randomU64, "%llu") &&
+            verify(edges, "%ld") && verify(pointers, "0x%" PRIXPTR);
+  printf("verify: %s\n", ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
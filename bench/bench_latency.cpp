@@ -0,0 +1,313 @@
+#include "async_logging.h"
+#include "logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace log;
+
+// 统计每次 LOG_INFO 调用的延迟分布（p50/p90/p99/p99.9/max），覆盖
+// 1..N 个生产者线程、短/长日志，以及空 sink 与经 AsyncLogging 写入真实文件
+// 两种输出端；结果以 JSON 输出到 stdout（或 -o 指定的文件），便于在版本之间
+// 对比，进度信息输出到 stderr
+
+// HDR 风格的直方图: 每个 2 的幂区间再等分为 kSubBuckets / 2 个桶，
+// 相对误差不超过 1/64，记录一次只需一次 clz 与一次自增
+class Histogram {
+public:
+  static constexpr int kSubBucketBits = 7;
+  static constexpr uint64_t kSubBuckets = 1u << kSubBucketBits;
+  static constexpr uint64_t kHalf = kSubBuckets / 2;
+  static constexpr size_t kBuckets =
+      kSubBuckets + (64 - kSubBucketBits) * kHalf;
+
+  Histogram() : counts_(kBuckets, 0) {}
+
+  void record(uint64_t value) {
+    ++counts_[index(value)];
+    ++total_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+  }
+
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < kBuckets; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  // 第 q（0~1）分位数，取所在桶的上界，不超过最大值
+  uint64_t percentile(double q) const {
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * total_));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        return std::min(upperBound(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  uint64_t total() const { return total_; }
+  uint64_t min() const { return total_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const {
+    return total_ ? static_cast<double>(sum_) / total_ : 0;
+  }
+
+private:
+  static size_t index(uint64_t value) {
+    if (value < kSubBuckets) {
+      return value;
+    }
+    // value >> shift 落在 [kHalf, kSubBuckets) 中
+    int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+    return kSubBuckets + (shift - 1) * kHalf + ((value >> shift) - kHalf);
+  }
+
+  static uint64_t upperBound(size_t index) {
+    if (index < kSubBuckets) {
+      return index;
+    }
+    size_t shift = (index - kSubBuckets) / kHalf + 1;
+    uint64_t sub = (index - kSubBuckets) % kHalf + kHalf;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t min_ = UINT64_MAX;
+  uint64_t max_ = 0;
+};
+
+// 空 sink: 只阻止编译器优化掉输出，不做任何 I/O，也不引入线程间竞争
+class NullSink {
+public:
+  void append(const char *msg, size_t, LogLevel) {
+    asm volatile("" : : "r"(msg) : "memory");
+  }
+};
+
+struct Config {
+  const char *sink;    // "null" 或 "file"
+  const char *message; // "short" 或 "long"
+  int threads;
+};
+
+struct Options {
+  int maxThreads = 4;
+  int calls = 200000; // 每个线程的调用次数
+  std::string dir = "/tmp";
+  AsyncLogging::FrontEnd frontEnd = AsyncLogging::FrontEnd::kShared;
+};
+
+inline uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 连续两次读取时钟的耗时，计入了每个样本
+uint64_t timerOverhead() {
+  Histogram histogram;
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t start = nowNs();
+    histogram.record(nowNs() - start);
+  }
+  return histogram.percentile(0.5);
+}
+
+void producer(const Config &config, int calls, Histogram *histogram) {
+  const std::string longStr(3000, 'X');
+  bool longLog = strcmp(config.message, "long") == 0;
+  // 首条日志会注册线程局部资源，不计入统计
+  LOG_INFO << "warm up";
+  for (int i = 0; i < calls; ++i) {
+    uint64_t start = nowNs();
+    if (longLog) {
+      LOG_INFO << "Hello 0123456789 abcdefghijklmnopqrstuvwxyz " << longStr
+               << i;
+    } else {
+      LOG_INFO << "Hello 0123456789 abcdefghijklmnopqrstuvwxyz " << i;
+    }
+    histogram->record(nowNs() - start);
+  }
+}
+
+// 删除 AsyncLogging 在 dir 中写出的日志文件
+void removeLogFiles(const std::string &dir, const std::string &prefix) {
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  while (struct dirent *entry = readdir(d)) {
+    if (strncmp(entry->d_name, prefix.c_str(), prefix.size()) == 0) {
+      unlink((dir + "/" + entry->d_name).c_str());
+    }
+  }
+  closedir(d);
+}
+
+void run(const Config &config, const Options &options, FILE *out,
+         bool first) {
+  static NullSink nullSink;
+  const std::string prefix = "bench_latency.";
+  std::unique_ptr<AsyncLogging> asyncLog;
+  bool file = strcmp(config.sink, "file") == 0;
+  if (file) {
+    // 阻塞而不丢弃，使延迟包含后端来不及写出时的等待
+    asyncLog = std::make_unique<AsyncLogging>(options.dir + "/" + prefix,
+                                              1000 * 1000 * 1000);
+    asyncLog->setFrontEnd(options.frontEnd);
+    asyncLog->setOverloadPolicy(AsyncLogging::OverloadPolicy::kBlock);
+    asyncLog->start();
+    setOutput<&AsyncLogging::append>(asyncLog.get());
+  } else {
+    setOutput<&NullSink::append>(&nullSink);
+  }
+
+  std::vector<Histogram> histograms(config.threads);
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (int t = 0; t < config.threads; ++t) {
+    threads.emplace_back(producer, std::cref(config), options.calls,
+                         &histograms[t]);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  uint64_t dropped = 0;
+  if (asyncLog) {
+    asyncLog->stop();
+    dropped = asyncLog->dropStats().totalMessages();
+    setOutput<&NullSink::append>(&nullSink);
+    asyncLog.reset();
+    removeLogFiles(options.dir, prefix);
+  }
+
+  Histogram total;
+  for (auto &histogram : histograms) {
+    total.merge(histogram);
+  }
+  double seconds = std::chrono::duration<double>(end - start).count();
+  fprintf(stderr,
+          "%-4s %-5s threads %2d: p50 %6lu ns  p99 %7lu ns  p99.9 %8lu ns  "
+          "max %9lu ns\n",
+          config.sink, config.message, config.threads,
+          static_cast<unsigned long>(total.percentile(0.5)),
+          static_cast<unsigned long>(total.percentile(0.99)),
+          static_cast<unsigned long>(total.percentile(0.999)),
+          static_cast<unsigned long>(total.max()));
+  fprintf(out,
+          "%s\n    {\"sink\": \"%s\", \"message\": \"%s\", \"threads\": %d, "
+          "\"calls\": %lu, \"dropped\": %lu, \"calls_per_sec\": %.0f,\n"
+          "     \"latency_ns\": {\"min\": %lu, \"mean\": %.1f, \"p50\": %lu, "
+          "\"p90\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}}",
+          first ? "" : ",", config.sink, config.message, config.threads,
+          static_cast<unsigned long>(total.total()),
+          static_cast<unsigned long>(dropped), total.total() / seconds,
+          static_cast<unsigned long>(total.min()), total.mean(),
+          static_cast<unsigned long>(total.percentile(0.5)),
+          static_cast<unsigned long>(total.percentile(0.9)),
+          static_cast<unsigned long>(total.percentile(0.99)),
+          static_cast<unsigned long>(total.percentile(0.999)),
+          static_cast<unsigned long>(total.max()));
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-t max threads] [-n calls] [-d dir] [-f shared|local] "
+          "[-o output.json]\n"
+          "  -t  最多的生产者线程数，依次测试 1, 2, 4, ... 个线程，默认 4\n"
+          "  -n  每个线程的调用次数，默认 200000\n"
+          "  -d  file sink 的日志目录，测试结束后删除，默认 /tmp\n"
+          "  -f  AsyncLogging 的前端缓冲模式，默认 shared\n"
+          "  -o  JSON 结果的输出文件，默认 stdout\n",
+          prog);
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  const char *output = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:d:f:o:")) != -1) {
+    switch (opt) {
+    case 't':
+      options.maxThreads = std::max(1, atoi(optarg));
+      break;
+    case 'n':
+      options.calls = std::max(1, atoi(optarg));
+      break;
+    case 'd':
+      options.dir = optarg;
+      break;
+    case 'f':
+      if (strcmp(optarg, "local") == 0) {
+        options.frontEnd = AsyncLogging::FrontEnd::kThreadLocal;
+      } else if (strcmp(optarg, "shared") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+  if (out == nullptr) {
+    perror(output);
+    return 1;
+  }
+
+  std::vector<int> threadCounts;
+  for (int n = 1; n < options.maxThreads; n *= 2) {
+    threadCounts.push_back(n);
+  }
+  threadCounts.push_back(options.maxThreads);
+
+  fprintf(out,
+          "{\"benchmark\": \"bench_latency\", \"front_end\": \"%s\", "
+          "\"calls_per_thread\": %d, \"hardware_threads\": %u,\n"
+          " \"timer_overhead_ns\": %lu,\n \"results\": [",
+          options.frontEnd == AsyncLogging::FrontEnd::kShared ? "shared"
+                                                              : "local",
+          options.calls, std::thread::hardware_concurrency(),
+          static_cast<unsigned long>(timerOverhead()));
+  bool first = true;
+  for (const char *sink : {"null", "file"}) {
+    for (const char *message : {"short", "long"}) {
+      for (int threads : threadCounts) {
+        run(Config{sink, message, threads}, options, out, first);
+        first = false;
+      }
+    }
+  }
+  fprintf(out, "\n]}\n");
+  if (out != stdout) {
+    fclose(out);
+  }
+}
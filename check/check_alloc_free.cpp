@@ -0,0 +1,131 @@
+#include "async_logging.h"
+#include "logging.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <string>
+#include <unistd.h>
+
+using namespace log;
+
+// 预热之后，经 AsyncLogging 输出的 LOG_INFO 在生产者线程上
+// 不应有任何堆内存分配；分配次数不为 0 时以非 0 退出。
+// 以 malloc 一族统计，operator new 与 LogBuffer 溢出区的分配都会经过这里
+
+namespace {
+
+std::atomic<long> g_allocCount(0);
+thread_local bool t_countAllocs = false;
+
+void logLines(int n, const std::string &text, const std::string &longText) {
+  for (int i = 0; i < n; ++i) {
+    LOG_INFO << "Hello 0123456789 " << text << ' ' << i << ' ' << i * 0.5
+             << ' ' << (i % 2 == 0);
+    // 正文与结构化字段都超过 LogBuffer 对象内的空间，同时使用溢出区
+    LOG_INFO.kv("id", i).kv("payload", longText) << "long " << longText;
+  }
+}
+
+long countAllocs(int batch) {
+  std::string text(200, 'X');
+  std::string longText(4000, 'L');
+  // 首批日志会注册线程局部资源、分配溢出区，不计入统计
+  logLines(100, text, longText);
+  g_allocCount = 0;
+  t_countAllocs = true;
+  logLines(batch, text, longText);
+  t_countAllocs = false;
+  return g_allocCount.load();
+}
+
+void removeDirectory(const std::string &dir) {
+  if (DIR *d = opendir(dir.c_str())) {
+    while (struct dirent *entry = readdir(d)) {
+      std::string name = entry->d_name;
+      if (name != "." && name != "..") {
+        unlink((dir + "/" + name).c_str());
+      }
+    }
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+} // namespace
+
+// 替换 glibc 的分配函数，转发到其内部实现
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+static void countAlloc() {
+  if (t_countAllocs) {
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void *malloc(size_t size) {
+  countAlloc();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  countAlloc();
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size) {
+  countAlloc();
+  return __libc_realloc(p, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  countAlloc();
+  return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+  countAlloc();
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **p, size_t alignment, size_t size) {
+  countAlloc();
+  *p = __libc_memalign(alignment, size);
+  return *p == nullptr ? ENOMEM : 0;
+}
+}
+
+int main() {
+  char dir[] = "/tmp/check_alloc_free.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  const int kBatch = 100000;
+  int failures = 0;
+  const AsyncLogging::FrontEnd frontEnds[] = {
+      AsyncLogging::FrontEnd::kShared, AsyncLogging::FrontEnd::kThreadLocal};
+  for (AsyncLogging::FrontEnd frontEnd : frontEnds) {
+    const char *name =
+        frontEnd == AsyncLogging::FrontEnd::kShared ? "shared" : "thread-local";
+    AsyncLogging asyncLog(std::string(dir) + "/" + name, 64 * 1024 * 1024);
+    asyncLog.setFrontEnd(frontEnd);
+    asyncLog.start();
+    setOutput<&AsyncLogging::append>(&asyncLog);
+
+    long allocs = countAllocs(kBatch);
+    asyncLog.stop();
+    printf("%s: %d lines, %ld allocations\n", name, kBatch * 2, allocs);
+    if (allocs != 0) {
+      ++failures;
+    }
+  }
+  removeDirectory(dir);
+  return failures == 0 ? 0 : 1;
+}
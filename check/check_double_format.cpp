@@ -0,0 +1,126 @@
+#include "log_stream.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace log;
+
+// LogStream::operator<<(double) 的默认输出须能经 strtod 精确还原；
+// setDoublePrecision(n) 的输出须与 snprintf("%.<n>g") 一致。
+// 任何一个值不满足时以非 0 退出
+// 注意: namespace log 与 <cmath> 中的 log() 冲突，这里不使用 <cmath>/<random>
+
+namespace {
+
+// xorshift64*
+struct Rng {
+  uint64_t state = 20240603;
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+  }
+  // [0, 1)
+  double uniform() { return (next() >> 11) * (1.0 / (1ULL << 53)); }
+};
+
+bool isFinite(double v) {
+  uint64_t u;
+  memcpy(&u, &v, sizeof u);
+  return (u & 0x7FF0000000000000ULL) != 0x7FF0000000000000ULL;
+}
+
+string format(LogStream &stream, double v) {
+  stream.resetBuffer();
+  stream << v;
+  return stream.buffer().toString();
+}
+
+// 最短表示必须能精确还原为同一个 double
+size_t roundTrip(const char *name, const std::vector<double> &values) {
+  LogStream stream;
+  size_t failures = 0;
+  for (double v : values) {
+    string text = format(stream, v);
+    double parsed = strtod(text.c_str(), nullptr);
+    if (memcmp(&parsed, &v, sizeof v) != 0 && failures++ < 10) {
+      fprintf(stderr, "round trip failed: %.17g -> %s\n", v, text.c_str());
+    }
+  }
+  printf("round trip %-12s %zu values, %zu failures\n", name, values.size(),
+         failures);
+  return failures;
+}
+
+// 固定有效数字位数时与 "%.<n>g" 的输出逐字节相同
+size_t precision(const std::vector<double> &values) {
+  LogStream stream;
+  size_t failures = 0;
+  for (int n = 1; n <= 17; ++n) {
+    LogStream::setDoublePrecision(n);
+    for (double v : values) {
+      char expected[64];
+      snprintf(expected, sizeof expected, "%.*g", n, v);
+      string text = format(stream, v);
+      if (text != expected && failures++ < 10) {
+        fprintf(stderr, "precision %d: %.17g -> %s, expected %s\n", n, v,
+                text.c_str(), expected);
+      }
+    }
+  }
+  LogStream::setDoublePrecision(0);
+  printf("precision 1..17: %zu values, %zu failures\n", values.size(),
+         failures);
+  return failures;
+}
+
+} // namespace
+
+int main() {
+  Rng rng;
+  const size_t kCount = 1 << 16;
+
+  // 任意位模式（排除 NaN/Inf）
+  std::vector<double> bits;
+  while (bits.size() < kCount) {
+    uint64_t u = rng.next();
+    double v;
+    memcpy(&v, &u, sizeof v);
+    if (isFinite(v)) {
+      bits.push_back(v);
+    }
+  }
+
+  // 典型的指标数据: 精确到微秒的毫秒级延迟、比率
+  std::vector<double> metrics;
+  while (metrics.size() < kCount) {
+    metrics.push_back(static_cast<int64_t>(rng.uniform() * 1000000) / 1000.0);
+    metrics.push_back(rng.uniform());
+  }
+
+  // 整数值
+  std::vector<double> integers;
+  while (integers.size() < kCount) {
+    integers.push_back(static_cast<double>(rng.next() % 1000001));
+  }
+
+  // 特殊值
+  std::vector<double> specials = {0.0,    -0.0,   1.0,     -1.0,   0.1,
+                                  1e-308, 5e-324, 1.7976931348623157e308,
+                                  1e21,   1e-7,   123456789012345678.0};
+
+  size_t failures = roundTrip("random bits", bits) +
+                    roundTrip("metrics", metrics) +
+                    roundTrip("integers", integers) +
+                    roundTrip("specials", specials);
+
+  std::vector<double> sample(bits.begin(), bits.begin() + 4096);
+  sample.insert(sample.end(), metrics.begin(), metrics.begin() + 4096);
+  sample.insert(sample.end(), specials.begin(), specials.end());
+  failures += precision(sample);
+  return failures == 0 ? 0 : 1;
+}
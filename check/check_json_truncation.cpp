@@ -0,0 +1,263 @@
+#include "logging.h"
+
+#include <cctype>
+#include <cstdio>
+#include <string>
+
+using namespace log;
+
+// JSON 格式下，正文、字段的键或值超过 maxMessageSize() 被截断后，
+// 每一行仍须是合法的 JSON，且不会截断 UTF-8 多字节字符；
+// 任何一行不合法时以非 0 退出
+
+namespace {
+
+// 最小的 JSON 校验器，只判断语法是否合法
+class JsonValidator {
+public:
+  explicit JsonValidator(const std::string &text)
+      : p_(text.data()), end_(text.data() + text.size()) {}
+
+  bool validate() {
+    skipSpace();
+    if (!value()) {
+      return false;
+    }
+    skipSpace();
+    return p_ == end_;
+  }
+
+private:
+  bool value() {
+    if (p_ == end_) {
+      return false;
+    }
+    switch (*p_) {
+    case '{':
+      return object();
+    case '[':
+      return array();
+    case '"':
+      return string();
+    case 't':
+      return literal("true");
+    case 'f':
+      return literal("false");
+    case 'n':
+      return literal("null");
+    default:
+      return number();
+    }
+  }
+
+  bool object() {
+    ++p_;
+    skipSpace();
+    if (p_ != end_ && *p_ == '}') {
+      ++p_;
+      return true;
+    }
+    for (;;) {
+      skipSpace();
+      if (!string()) {
+        return false;
+      }
+      skipSpace();
+      if (p_ == end_ || *p_++ != ':') {
+        return false;
+      }
+      skipSpace();
+      if (!value()) {
+        return false;
+      }
+      skipSpace();
+      if (p_ == end_) {
+        return false;
+      }
+      char c = *p_++;
+      if (c == '}') {
+        return true;
+      }
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+
+  bool array() {
+    ++p_;
+    skipSpace();
+    if (p_ != end_ && *p_ == ']') {
+      ++p_;
+      return true;
+    }
+    for (;;) {
+      skipSpace();
+      if (!value()) {
+        return false;
+      }
+      skipSpace();
+      if (p_ == end_) {
+        return false;
+      }
+      char c = *p_++;
+      if (c == ']') {
+        return true;
+      }
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+
+  bool string() {
+    if (p_ == end_ || *p_ != '"') {
+      return false;
+    }
+    for (++p_; p_ != end_; ++p_) {
+      unsigned char c = static_cast<unsigned char>(*p_);
+      if (c == '"') {
+        ++p_;
+        return true;
+      }
+      if (c < 0x20) {
+        return false;
+      }
+      if (c >= 0x80 && !utf8()) {
+        return false;
+      }
+      if (c == '\\') {
+        if (++p_ == end_) {
+          return false;
+        }
+        if (*p_ == 'u') {
+          for (int i = 0; i < 4; ++i) {
+            if (++p_ == end_ || !isxdigit(static_cast<unsigned char>(*p_))) {
+              return false;
+            }
+          }
+        } else if (std::string("\"\\/bfnrt").find(*p_) == std::string::npos) {
+          return false;
+        }
+      }
+    }
+    return false;
+  }
+
+  // p_ 指向多字节字符的首字节，校验后停在其最后一个字节
+  bool utf8() {
+    unsigned char c = static_cast<unsigned char>(*p_);
+    int continuations = (c & 0xE0) == 0xC0   ? 1
+                        : (c & 0xF0) == 0xE0 ? 2
+                        : (c & 0xF8) == 0xF0 ? 3
+                                             : -1;
+    if (continuations < 0) {
+      return false;
+    }
+    for (int i = 0; i < continuations; ++i) {
+      if (++p_ == end_ || (static_cast<unsigned char>(*p_) & 0xC0) != 0x80) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool number() {
+    const char *start = p_;
+    if (p_ != end_ && *p_ == '-') {
+      ++p_;
+    }
+    const char *digits = p_;
+    while (p_ != end_ && (isdigit(static_cast<unsigned char>(*p_)) ||
+                          *p_ == '.' || *p_ == 'e' || *p_ == 'E' ||
+                          *p_ == '+' || *p_ == '-')) {
+      ++p_;
+    }
+    return p_ > digits && p_ > start;
+  }
+
+  bool literal(const char *word) {
+    for (; *word != '\0'; ++word, ++p_) {
+      if (p_ == end_ || *p_ != *word) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void skipSpace() {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\t' ||
+                          *p_ == '\r')) {
+      ++p_;
+    }
+  }
+
+  const char *p_;
+  const char *end_;
+};
+
+std::string g_line;
+
+void captureOutput(void *, const char *msg, int len, LogLevel) {
+  g_line.assign(msg, len);
+}
+
+int g_failures = 0;
+int g_truncated = 0;
+
+void check(const char *what, size_t n) {
+  if (g_line.find("...(truncated)") != std::string::npos) {
+    ++g_truncated;
+  }
+  if (!JsonValidator(g_line).validate()) {
+    if (++g_failures <= 5) {
+      fprintf(stderr, "invalid JSON (%s, %zu bytes): %.200s...%s\n", what, n,
+              g_line.c_str(),
+              g_line.substr(g_line.size() > 120 ? g_line.size() - 120 : 0)
+                  .c_str());
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  setFormat(LogFormat::kJson);
+  setOutput(captureOutput, nullptr);
+
+  // 审查中复现的情形: 默认上限下超长的字符串字段
+  LOG_INFO.kv("payload", std::string(70000, 'a')) << "m";
+  check("payload", 70000);
+
+  // 在较小的上限附近逐字节扫过各个截断位置
+  const size_t kLimit = 1024;
+  LogStream::setMaxMessageSize(kLimit);
+  for (size_t n = 0; n < kLimit + 200; ++n) {
+    std::string text(n, 'x');
+    // 需要转义的字符使截断点落在转义序列中间
+    std::string quoted(n / 2, '"');
+    // 2、3、4 字节的字符交替出现，截断点落在各个字节上
+    std::string utf8;
+    while (utf8.size() < n) {
+      utf8 += "\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80";
+    }
+    LOG_INFO.kv("value", text) << "m";
+    check("value", n);
+    LOG_INFO.kv("quoted", quoted).kv("after", 1) << "m";
+    check("quoted", n);
+    LOG_INFO.kv(text, 42).kv("after", "x") << "m";
+    check("key", n);
+    LOG_INFO.kv("a", text).kv("b", 3.5).kv("c", true).kv("d", text) << text;
+    check("fields", n);
+    LOG_INFO << text << quoted;
+    check("message", n);
+    LOG_INFO.kv("utf8", utf8) << utf8;
+    check("utf8", n);
+    LOG_INFO.kv(utf8, 1) << "m";
+    check("utf8 key", n);
+  }
+
+  printf("%d truncated lines checked, %d invalid\n", g_truncated,
+         g_failures);
+  return g_failures == 0 && g_truncated > 0 ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include "logging.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace log;
+
+// 其它线程持续输出日志时反复 setOutput()/setFlush()，被替换的函数对象
+// 及其捕获的对象最终都应被析构；有对象泄漏时以非 0 退出
+
+namespace {
+
+std::atomic<int> g_alive(0);
+std::atomic<long> g_lines(0);
+
+struct Sink {
+  Sink() { ++g_alive; }
+  ~Sink() { --g_alive; }
+};
+
+} // namespace
+
+int main() {
+  setOutput([](const char *, int, LogLevel) {});
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&]() {
+      while (!stop) {
+        LOG_INFO << "line";
+      }
+    });
+  }
+  for (int i = 0; i < 3000; ++i) {
+    auto sink = std::make_shared<Sink>();
+    if (i % 3 == 0) {
+      setFlush([sink]() {});
+    } else {
+      setOutput([sink](const char *, int, LogLevel) { ++g_lines; });
+    }
+    // 让输出日志的线程在替换之间运行
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  // 最后一次替换后，此前的输出端都已没有读者
+  setOutput([](const char *, int, LogLevel) {});
+  setFlush([]() {});
+
+  printf("%ld lines, %d sinks still alive\n", g_lines.load(), g_alive.load());
+  return g_alive == 0 && g_lines > 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "sink_dispatcher.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sys/resource.h>
+#include <thread>
+
+using namespace log;
+
+// 各 sink 只收到不低于其级别的日志，收到与丢弃的条数之和等于应收的条数；
+// 只接收少量日志的慢 sink 不能使共享块无限增长。任何一项不满足时以非 0 退出
+
+namespace {
+
+class CountingSink : public LogSink {
+public:
+  CountingSink(LogLevel level, int delayMs)
+      : level_(level), delayMs_(delayMs) {}
+
+  void write(const char *logline, size_t len) override {
+    if (len > 8 && memcmp(logline, "Dropped ", 8) == 0) {
+      return; // dispatcher 报告丢弃的提示
+    }
+    if (static_cast<LogLevel>(logline[0] - '0') < level_) {
+      ++wrongLevel;
+    }
+    ++received;
+    if (delayMs_ > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(delayMs_));
+    }
+  }
+
+  uint64_t received = 0;
+  uint64_t wrongLevel = 0;
+
+private:
+  LogLevel level_;
+  int delayMs_;
+};
+
+long maxRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+} // namespace
+
+int main() {
+  const uint64_t kLines = 5000000;
+  const long kMaxRssKb = 256 * 1024;
+
+  SinkDispatcher dispatcher;
+  auto all = std::make_shared<CountingSink>(LogLevel::TRACE, 0);
+  auto warn = std::make_shared<CountingSink>(LogLevel::WARN, 0);
+  // 每条 ERROR 写 10ms，远远跟不上
+  auto slow = std::make_shared<CountingSink>(LogLevel::ERROR, 10);
+  size_t allIndex = dispatcher.addSink(all, LogLevel::TRACE);
+  size_t warnIndex = dispatcher.addSink(warn, LogLevel::WARN);
+  size_t slowIndex = dispatcher.addSink(slow, LogLevel::ERROR, 4 * 1024 * 1024);
+  dispatcher.start();
+
+  // 约 100 字节一行，每 1000 行一条 WARN，每 10000 行一条 ERROR
+  char line[100];
+  memset(line, 'x', sizeof line);
+  line[sizeof line - 1] = '\n';
+  uint64_t warns = 0;
+  uint64_t errors = 0;
+  for (uint64_t i = 1; i <= kLines; ++i) {
+    LogLevel level = i % 10000 == 0  ? LogLevel::ERROR
+                     : i % 1000 == 0 ? LogLevel::WARN
+                                     : LogLevel::INFO;
+    warns += level >= LogLevel::WARN;
+    errors += level == LogLevel::ERROR;
+    line[0] = static_cast<char>('0' + static_cast<int>(level));
+    dispatcher.append(line, sizeof line, level);
+  }
+  dispatcher.stop();
+  // stop() 之后的日志被忽略
+  dispatcher.append(line, sizeof line, LogLevel::ERROR);
+
+  struct Expect {
+    const char *name;
+    CountingSink *sink;
+    size_t index;
+    uint64_t lines;
+  } expects[] = {{"all", all.get(), allIndex, kLines},
+                 {"warn", warn.get(), warnIndex, warns},
+                 {"slow error", slow.get(), slowIndex, errors}};
+
+  int failures = 0;
+  for (const Expect &e : expects) {
+    uint64_t dropped = dispatcher.droppedMessages(e.index);
+    printf("%s: %llu received, %llu dropped, %llu expected\n", e.name,
+           static_cast<unsigned long long>(e.sink->received),
+           static_cast<unsigned long long>(dropped),
+           static_cast<unsigned long long>(e.lines));
+    if (e.sink->received + dropped != e.lines || e.sink->wrongLevel != 0) {
+      ++failures;
+    }
+  }
+  if (dispatcher.droppedMessages(slowIndex) == 0) {
+    fprintf(stderr, "slow sink never dropped\n");
+    ++failures;
+  }
+  long rss = maxRssKb();
+  printf("max rss %ld KB\n", rss);
+  if (rss > kMaxRssKb) {
+    fprintf(stderr, "memory is not bounded by maxQueueBytes\n");
+    ++failures;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -24,23 +24,49 @@
 using std::string;
 
 namespace log {
+
+/**
+ * 写文件的方式
+ * kStdio: 经 stdio 缓冲后写入
+ * kWritev: 大块数据直接从调用者的内存 pwritev，小块数据先在内部缓冲区中合并
+ * kIoUring: 在 kWritev 的基础上，submit() 的数据经 io_uring 异步写入，
+ *           内核不支持时退化为 kStdio
+ * kMmap: 写入预分配的内存映射区，见 mapped_file.h，映射失败时退化为 kStdio
+ * directIO 仅对 kWritev/kIoUring 有效: 数据先拷贝到页对齐的缓冲区，
+ *          再以 O_DIRECT 整块写入，绕过页缓存；文件系统不支持时忽略
+ */
+enum class WriteBackend { kStdio, kWritev, kIoUring, kMmap };
+
 class AppendFile {
   NOCOPYABLE_DECLARE(AppendFile)
 
 public:
-  AppendFile(const string &filename);
+  // segmentSize: kMmap 模式下每次预分配并映射的字节数，通常为回滚大小
+  AppendFile(const string &filename,
+             WriteBackend backend = WriteBackend::kStdio,
+             bool directIO = false, size_t segmentSize = 0);
   ~AppendFile();
 
+  // 返回后 logline 即可复用
   void append(const char *logline, size_t len);
 
+  // 提交后立即返回，data 在 wait() 返回或 pending() 为 false 之前须保持有效
+  // 不支持异步写入时等同于 append()
+  void submit(const char *data, size_t len);
+  void wait();
+  bool pending();
+
   void flush();
 
   size_t writtenBytes() const;
 
 private:
   class Impl;
+  class StdioFile;
+  class DescriptorFile;
+  class MappedImpl;
   std::unique_ptr<Impl> impl_;
 };
 } // namespace log
 
-#endif
\ No newline at end of file
+#endif
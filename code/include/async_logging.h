@@ -18,8 +18,13 @@
 #ifndef __ASYNC_LOGGING_H__
 #define __ASYNC_LOGGING_H__
 
+#include "append_file.h"
+#include "log_file.h"
+#include "logger.h"
 #include "noncopyable.h"
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <mutex>
 
@@ -28,11 +33,144 @@ class AsyncLogging {
   NOCOPYABLE_DECLARE(AsyncLogging);
 
 public:
+  /**
+   * 前端缓冲模式
+   * kShared: 所有生产者线程共享 currentBuffer_，由 mutex_ 保护
+   * kThreadLocal: 每个生产者线程写入各自的无锁环形缓冲区，由后端线程汇总，
+   *               生产者之间、生产者与后端线程之间均不竞争锁
+   */
+  enum class FrontEnd { kShared, kThreadLocal };
+
+  /**
+   * 缓冲区中的记录格式
+   * kText: 已格式化好的文本行
+   * kBinary: binary_logging.h 定义的二进制记录，由后端线程解码为文本后写入
+   * kBinaryFile: 二进制记录原样写入文件，由 log_decoder 离线解码
+   * 二进制格式下，append() 的文本行会被包装为文本记录
+   */
+  enum class RecordFormat { kText, kBinary, kBinaryFile };
+
+  /**
+   * 过载策略: 前端缓冲区池（kThreadLocal 模式下为本线程的环形缓冲区）
+   *          耗尽时如何处理新的日志
+   * kBlock: 阻塞生产者，直到后端线程腾出空间
+   * kDropNewest: 丢弃当前这条日志
+   * kDropOldest: 丢弃最早一块尚未交给后端线程的缓冲区，并复用它；
+   *              kThreadLocal 模式下等同于 kDropNewest
+   * kDropByLevel: 空间紧张时丢弃低于 keepLevel 的日志，为其余日志预留空间，
+   *               keepLevel 及以上的日志在耗尽时阻塞等待，保证不丢失
+   * kSample: 与 kDropByLevel 相同，但低于 keepLevel 的日志每 sampleRate 条
+   *          保留一条
+   */
+  enum class OverloadPolicy {
+    kBlock,
+    kDropNewest,
+    kDropOldest,
+    kDropByLevel,
+    kSample,
+  };
+
+  // 各级别被丢弃的日志条数与字节数，自创建以来累计
+  struct DropStats {
+    static constexpr size_t kNumLevels =
+        static_cast<size_t>(LogLevel::NUM_LOG_LEVELS);
+    uint64_t messages[kNumLevels];
+    uint64_t bytes[kNumLevels];
+
+    uint64_t totalMessages() const;
+    uint64_t totalBytes() const;
+  };
+
+  /**
+   * 运行统计，自创建以来累计，用于确定缓冲区大小、及早发现日志拖慢业务
+   * 生产者: 进入前端缓冲区的日志条数与字节数；kShared 模式下写满后交换
+   *         缓冲区的次数；获取 mutex_ 需要等待的次数与时间；缓冲区耗尽时
+   *         阻塞等待（kBlock 等策略）的次数与时间
+   * 后端线程: 每轮写出的字节数，写入与 flush 的耗时
+   * 时间单位均为纳秒
+   */
+  struct Stats {
+    uint64_t appendedMessages;
+    uint64_t appendedBytes;
+    uint64_t bufferSwaps;
+    uint64_t lockWaits;
+    uint64_t lockWaitNanos;
+    uint64_t bufferWaits;
+    uint64_t bufferWaitNanos;
+
+    uint64_t batches; // 写出了日志的轮数
+    uint64_t batchBytes;
+    uint64_t maxBatchBytes;
+    uint64_t writeNanos;
+    uint64_t maxWriteNanos;
+    uint64_t flushes;
+    uint64_t flushNanos;
+    uint64_t maxFlushNanos;
+
+    DropStats drops;
+  };
+
+  static constexpr size_t kDefaultRingSize = 1024 * 1024;
+  static constexpr size_t kDefaultPoolSize = 16;
+
   AsyncLogging(const std::string &basename, int rollSize,
                int flushInterval = 3);
   ~AsyncLogging();
 
-  void append(const char *logline, size_t len);
+  // 需在 start() 之前、第一次 append() 之前调用
+  void setFrontEnd(FrontEnd frontEnd, size_t ringSize = kDefaultRingSize);
+  void setRecordFormat(RecordFormat format);
+
+  // 日志文件的写入方式，见 append_file.h
+  // kShared 模式下文本与 kBinaryFile 记录的缓冲区直接提交写入，不再拷贝
+  void setWriteBackend(WriteBackend backend, bool directIO = false);
+
+  // 按时间回滚、旧文件压缩与保留数量，见 LogFileOptions
+  void setRolling(RollPeriod period,
+                  Compression compression = Compression::kNone,
+                  size_t maxFiles = 0, uint64_t maxTotalBytes = 0);
+
+  // 写入日志文件前流式压缩，见 LogFileOptions::streamCompression
+  void setStreamCompression(Compression compression);
+
+  // 预分配 buffers 块 4MB 缓冲区，此后前后端只在池内循环复用，内存有界
+  // lockMemory: mlock 锁定；hugePages: 优先使用大页
+  // 需在 start() 之前、第一次 append() 之前调用
+  void setBufferPool(size_t buffers, bool lockMemory = false,
+                     bool hugePages = false);
+
+  // 默认为 kDropNewest
+  void setOverloadPolicy(OverloadPolicy policy,
+                         LogLevel keepLevel = LogLevel::WARN,
+                         uint32_t sampleRate = 100);
+
+  // 未指定级别的日志按 INFO 处理
+  void append(const char *logline, size_t len,
+              LogLevel level = LogLevel::INFO);
+
+  // 追加一条二进制记录，kText 格式下在调用线程上解码为文本
+  void appendRecord(const char *record, size_t len,
+                    LogLevel level = LogLevel::INFO);
+
+  DropStats dropStats() const;
+
+  // 计数器均为 relaxed 原子变量，各项之间不保证严格一致；kThreadLocal 模式
+  // 下需短暂持有锁以累加各线程的环形缓冲区
+  Stats stats() const;
+
+  // 后端线程每隔 seconds 秒将统计写入日志文件，0（默认）表示不写入；
+  // 需在 start() 之前调用
+  void setStatsInterval(int seconds);
+
+  /**
+   * 按时间戳排序输出: 仅对 kThreadLocal 前端有效，需在 start() 之前调用。
+   * 每条记录带有日志的时间戳（见 takeRecordTime()，宜配合 ClockSource::kTsc），
+   * 后端线程在各线程的环形缓冲区之间按时间戳做 k 路归并，只写出早于
+   * max(当前时间 - milliseconds, 各活跃线程最近一条记录的时间戳) 的记录，
+   * 其余留到下一轮，因此输出在该窗口内按时间有序。0（默认）表示不排序，
+   * 各线程的日志成批交错写出。kShared 前端按获得 mutex_ 的顺序写出
+   */
+  void setReorderWindow(int milliseconds);
 
   void start();
 
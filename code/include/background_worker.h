@@ -0,0 +1,54 @@
+/* =====================================================================================
+ *
+ *       Filename:  background_worker.h
+ *
+ *    Description:  进程内共享的低优先级后台线程，执行压缩、预创建文件等耗时任务
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __BACKGROUND_WORKER_H__
+#define __BACKGROUND_WORKER_H__
+
+#include "noncopyable.h"
+#include "singleton.h"
+#include <functional>
+#include <memory>
+
+namespace log {
+
+/**
+ * background worker: 首次 post() 时启动唯一的线程，以 SCHED_IDLE 调度、
+ *                    idle 类 I/O 优先级运行，任务按提交顺序依次执行
+ *                    进程退出时执行完剩余的任务。
+ *                    urgent() 是以正常优先级运行的另一个实例，
+ *                    用于有时限的短任务，不排在压缩等耗时的任务之后
+ * */
+class BackgroundWorker {
+  NOCOPYABLE_DECLARE(BackgroundWorker)
+  SINGLETON_PATTERN_DECLARE(BackgroundWorker)
+
+public:
+  using Task = std::function<void()>;
+
+  static BackgroundWorker &urgent();
+
+  void post(Task task);
+
+private:
+  explicit BackgroundWorker(bool idle);
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+} // namespace log
+
+#endif
@@ -0,0 +1,52 @@
+/* =====================================================================================
+ *
+ *       Filename:  binary_decoder.h
+ *
+ *    Description:  将二进制日志记录还原为文本日志行
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __BINARY_DECODER_H__
+#define __BINARY_DECODER_H__
+
+#include "noncopyable.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+using std::string;
+
+namespace log {
+
+/**
+ * binary decoder: 输出格式与 Logger 完全一致，调用点信息来自记录流中的
+ *                 定义记录；useRegistry 为 true 时也会查找本进程的注册表
+ * */
+class BinaryDecoder {
+  NOCOPYABLE_DECLARE(BinaryDecoder)
+
+public:
+  explicit BinaryDecoder(bool useRegistry);
+  ~BinaryDecoder();
+
+  // 解码 data 中的完整记录并追加到 out，返回消费的字节数，
+  // 末尾不完整的记录留待下次与后续数据一起解码
+  size_t decode(const char *data, size_t len, string *out);
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+} // namespace log
+
+#endif
@@ -0,0 +1,201 @@
+/* =====================================================================================
+ *
+ *       Filename:  binary_logging.h
+ *
+ *    Description:  延迟格式化的二进制日志：前端只序列化调用点编号与原始参数，
+ *                  文本格式化由后端线程或离线解码工具完成
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __BINARY_LOGGING_H__
+#define __BINARY_LOGGING_H__
+
+#include "logging.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace log {
+
+/**
+ * 日志调用点: 每条 LOG_FMT 语句对应一个静态对象，首次执行时注册并获得编号
+ *            format 中的 "{}" 为参数占位符，多余的参数以空格分隔追加在末尾
+ */
+struct LogSite {
+  const char *format;
+  SourceFile file;
+  int line;
+  LogLevel level;
+  std::atomic<uint32_t> id{0}; // 0 表示尚未注册
+};
+
+// 注册调用点，返回其编号（从 1 开始）
+uint32_t registerLogSite(LogSite *site);
+// 已注册的调用点个数及按编号查找，编号无效时返回 nullptr
+uint32_t logSiteCount();
+const LogSite *findLogSite(uint32_t id);
+
+// 二进制记录的输出函数，未设置时 LOG_FMT 退化为普通的同步格式化
+void setBinaryOutput(LevelOutputFunc);
+bool hasBinaryOutput();
+void binaryOutput(const char *record, int len, LogLevel level);
+
+namespace binary {
+/**
+ * 记录格式（小端，字段不对齐）:
+ *   | u32 size | u32 siteId | 负载 |，size 包含 8 字节的记录头
+ *   siteId == kTextSite:       负载为已格式化好的文本行
+ *   siteId == kSiteDefinition: 负载为调用点定义，仅出现在二进制日志文件中
+ *                              | u32 id | i32 line | u8 level |
+ *                              | u16 len | file | u16 len | format |
+ *   其余 siteId:                | i64 微秒时间戳 | i32 tid | 参数... |
+ *                              每个参数为 | u8 ArgType | 值 |，
+ *                              kString 的值为 | u32 len | 字节 |
+ */
+constexpr uint32_t kTextSite = 0;
+constexpr uint32_t kSiteDefinition = 0xFFFFFFFF;
+constexpr size_t kRecordHeaderSize = 8;
+constexpr size_t kEventHeaderSize = kRecordHeaderSize + 12;
+
+enum class ArgType : uint8_t {
+  kInt64,
+  kUInt64,
+  kDouble,
+  kString,
+  kChar,
+  kBool,
+  kPointer,
+};
+
+inline void encodeRecordHeader(char *buf, uint32_t size, uint32_t siteId) {
+  memcpy(buf, &size, sizeof size);
+  memcpy(buf + 4, &siteId, sizeof siteId);
+}
+
+// 追加调用点定义记录到 out
+void encodeSiteDefinition(uint32_t id, const LogSite &site, string *out);
+
+/**
+ * record encoder: 在栈上的固定缓冲区中组装一条记录，超出部分的参数被丢弃
+ * */
+class RecordEncoder {
+  NOCOPYABLE_DECLARE(RecordEncoder)
+
+public:
+  explicit RecordEncoder(uint32_t siteId);
+
+  void add(bool v) { put(ArgType::kBool, static_cast<uint8_t>(v)); }
+  void add(char v) { put(ArgType::kChar, v); }
+  void add(float v) { add(static_cast<double>(v)); }
+  void add(double v) { put(ArgType::kDouble, v); }
+  void add(const void *p) {
+    put(ArgType::kPointer,
+        static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)));
+  }
+  void add(const char *str) {
+    if (str) {
+      addString(str, strlen(str));
+    } else {
+      addString("(null)", 6);
+    }
+  }
+  void add(const unsigned char *str) {
+    add(reinterpret_cast<const char *>(str));
+  }
+  void add(const string &v) { addString(v.data(), v.size()); }
+  void add(const StringPiece &v) { addString(v.data(), v.size()); }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value>::type add(T v) {
+    if (std::is_signed<T>::value) {
+      put(ArgType::kInt64, static_cast<int64_t>(v));
+    } else {
+      put(ArgType::kUInt64, static_cast<uint64_t>(v));
+    }
+  }
+
+  // 回填记录长度后返回完整记录
+  const char *data() {
+    encodeRecordHeader(buf_, static_cast<uint32_t>(len_), siteId_);
+    return buf_;
+  }
+  size_t length() const { return len_; }
+
+private:
+  template <typename T> void put(ArgType type, T v) {
+    if (len_ + 1 + sizeof v <= sizeof buf_) {
+      buf_[len_] = static_cast<char>(type);
+      memcpy(buf_ + len_ + 1, &v, sizeof v);
+      len_ += 1 + sizeof v;
+    }
+  }
+
+  void addString(const char *str, size_t len);
+
+  const uint32_t siteId_;
+  size_t len_;
+  char buf_[kSmallBuffer];
+};
+
+// 按 format 同步格式化到 stream，规则与解码器一致
+inline void formatTo(LogStream &stream, const char *format) {
+  stream << format;
+}
+
+template <typename T, typename... Args>
+void formatTo(LogStream &stream, const char *format, const T &first,
+              const Args &...rest) {
+  const char *placeholder = strstr(format, "{}");
+  if (placeholder) {
+    stream.append(format, static_cast<int>(placeholder - format));
+    stream << first;
+    formatTo(stream, placeholder + 2, rest...);
+  } else {
+    stream << format << ' ' << first;
+    formatTo(stream, "", rest...);
+  }
+}
+} // namespace binary
+
+template <typename... Args>
+void logFormat(LogSite &site, const Args &...args) {
+  uint32_t id = site.id.load(std::memory_order_acquire);
+  if (__builtin_expect(id == 0, 0)) {
+    id = registerLogSite(&site);
+  }
+  // FATAL 需要同步输出并终止进程，未设置二进制输出时同样退化为同步格式化
+  if (!hasBinaryOutput() || site.level == LogLevel::FATAL) {
+    Logger logger(site.file, site.line, site.level);
+    binary::formatTo(logger.stream(), site.format, args...);
+    return;
+  }
+  binary::RecordEncoder encoder(id);
+  (encoder.add(args), ...);
+  binaryOutput(encoder.data(), static_cast<int>(encoder.length()), site.level);
+}
+
+/**
+ * 用法: LOG_FMT(INFO, "user {} latency {} us", id, latency);
+ *      级别过滤规则与 LOG_* 相同
+ */
+#define LOG_FMT(level, format, ...)                                            \
+  LOG_IF_LEVEL(level, LOG_LIKELY)                                              \
+  do {                                                                         \
+    static ::log::LogSite logSite_{format, LOG_SOURCE_FILE, __LINE__,          \
+                                   LogLevel::level};                           \
+    ::log::logFormat(logSite_, ##__VA_ARGS__);                                 \
+  } while (0)
+
+} // namespace log
+
+#endif
@@ -0,0 +1,124 @@
+/* =====================================================================================
+ *
+ *       Filename:  buffer_pool.h
+ *
+ *    Description:  预分配的缓冲区池，前端与后端线程循环复用其中的缓冲区
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+
+#include "noncopyable.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <vector>
+
+namespace log {
+
+/**
+ * buffer pool: 构造时一次性映射全部缓冲区的内存，之后不再分配
+ *              lockMemory: mlock 锁定内存，避免被换出，同时预先完成缺页
+ *              hugePages: 优先使用 MAP_HUGETLB 大页，失败时退化为透明大页
+ *              本身不加锁，由调用者保证互斥
+ * */
+template <typename T> class BufferPool {
+  NOCOPYABLE_DECLARE(BufferPool)
+
+public:
+  BufferPool(size_t count, bool lockMemory, bool hugePages)
+      : memory_(MAP_FAILED), bytes_(0), locked_(false) {
+    const size_t stride = (sizeof(T) + 63) & ~static_cast<size_t>(63);
+    bytes_ = stride * count;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (lockMemory) {
+      flags |= MAP_POPULATE;
+    }
+    if (hugePages) {
+      bytes_ = (bytes_ + kHugePageSize - 1) & ~(kHugePageSize - 1);
+      memory_ = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+                     flags | MAP_HUGETLB, -1, 0);
+    }
+    if (memory_ == MAP_FAILED) {
+      memory_ = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, flags, -1, 0);
+      if (memory_ == MAP_FAILED) {
+        fprintf(stderr, "BufferPool: mmap %zu bytes failed: %s\n", bytes_,
+                strerror(errno));
+        abort();
+      }
+      if (hugePages) {
+        madvise(memory_, bytes_, MADV_HUGEPAGE);
+      }
+    }
+    if (lockMemory) {
+      locked_ = mlock(memory_, bytes_) == 0;
+      if (!locked_) {
+        fprintf(stderr, "BufferPool: mlock %zu bytes failed: %s\n", bytes_,
+                strerror(errno));
+      }
+    }
+
+    free_.reserve(count);
+    all_.reserve(count);
+    char *base = static_cast<char *>(memory_);
+    for (size_t i = 0; i < count; ++i) {
+      T *buffer = new (base + i * stride) T;
+      all_.push_back(buffer);
+      free_.push_back(buffer);
+    }
+  }
+
+  ~BufferPool() {
+    for (T *buffer : all_) {
+      buffer->~T();
+    }
+    if (locked_) {
+      munlock(memory_, bytes_);
+    }
+    munmap(memory_, bytes_);
+  }
+
+  // 池已耗尽时返回 nullptr
+  T *acquire() {
+    if (free_.empty()) {
+      return nullptr;
+    }
+    T *buffer = free_.back();
+    free_.pop_back();
+    return buffer;
+  }
+
+  void release(T *buffer) {
+    buffer->reset();
+    free_.push_back(buffer);
+  }
+
+  size_t available() const { return free_.size(); }
+  size_t capacity() const { return all_.size(); }
+
+private:
+  static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+  void *memory_;
+  size_t bytes_;
+  bool locked_;
+  std::vector<T *> all_;
+  std::vector<T *> free_;
+};
+
+} // namespace log
+
+#endif
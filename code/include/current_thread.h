@@ -15,6 +15,9 @@
  * =====================================================================================
  */
 
+#ifndef __CURRENT_THREAD_H__
+#define __CURRENT_THREAD_H__
+
 #include <thread>
 namespace log {
 namespace currentthread {
@@ -49,4 +52,6 @@ inline const char *name() { return t_threadName; }
 bool isMainThread();
 
 } // namespace currentthread
-} // namespace log
\ No newline at end of file
+} // namespace log
+
+#endif
@@ -0,0 +1,48 @@
+/* =====================================================================================
+ *
+ *       Filename:  escape.h
+ *
+ *    Description:  结构化日志（JSON / logfmt）的字符串转义
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __ESCAPE_H__
+#define __ESCAPE_H__
+
+#include <cstddef>
+
+namespace log {
+
+/**
+ * 需要转义的字符为 '"'、'\\' 与 0x00~0x1F 的控制字符，
+ * 以 SSE2 每次检查 16 字节，绝大多数日志内容无需转义，只需一次扫描
+ * */
+
+// 返回第一个需要转义的字符的下标，没有则返回 len
+size_t findJsonEscape(const char *src, size_t len);
+
+// 在 pos 处截断 src 时，退回到 pos 所在的 UTF-8 多字节字符之前；
+// src[pos] 须可读
+size_t utf8Boundary(const char *src, size_t pos);
+
+// 转义后写入 dst，最多写入 cap 字节，空间不足时丢弃其余内容，
+// 但不会截断一个转义序列或 UTF-8 多字节字符；返回写入的字节数，
+// consumed 非空时存放已转义的源字节数
+size_t escapeJson(const char *src, size_t len, char *dst, size_t cap,
+                  size_t *consumed = nullptr);
+
+// logfmt 的值为空或含空格、'='、'"'、'\\'、控制字符时需要加引号，
+// 引号内的转义规则与 JSON 相同
+bool logfmtNeedsQuote(const char *src, size_t len);
+} // namespace log
+
+#endif
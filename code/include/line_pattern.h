@@ -0,0 +1,144 @@
+/* =====================================================================================
+ *
+ *       Filename:  line_pattern.h
+ *
+ *    Description:  日志行模板，启动时编译为一串格式化操作
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __LINE_PATTERN_H__
+#define __LINE_PATTERN_H__
+
+#include "log_stream.h"
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+namespace log {
+
+enum class LogLevel : unsigned long;
+
+/**
+ * line pattern: 文本格式（LogFormat::kText）的日志行布局
+ *   %D  日期 YYYY-MM-DD          %T  时间 HH:MM:SS（UTC）
+ *   %u  6 位微秒                 %e  3 位毫秒
+ *   %t  线程 id，宽度 5          %l  级别名，宽度 5
+ *   %m  正文与结构化字段         %f  源文件名
+ *   %n  行号                     %%  字符 '%'
+ * %m 之前的部分在 Logger 构造时输出，之后的部分在析构时输出，
+ * 没有 %m 时正文位于行末；每行总以 '\n' 结尾
+ * */
+class LinePattern {
+public:
+  // 与原先固定的布局完全一致
+  static constexpr const char *kDefaultPattern =
+      "%D %T.%u(UTC)%t %l %m - %f:%n";
+
+  // 格式化一行所需的信息
+  struct Context {
+    time_t seconds;
+    int microseconds;
+    // 不含结尾空格；行首按 tid 指针缓存，同一指针指向的内容改变时
+    // 需调用 invalidateThreadCache()
+    const char *tid;
+    int tidLength;
+    LogLevel level;
+    const char *file;
+    int fileLength;
+    int line;
+  };
+
+  LinePattern();
+
+  // pattern 无效时输出错误信息并返回 false，原有的布局保持不变
+  bool compile(const char *pattern);
+
+  // 是否用到时间，不用时 Logger 无需读取时钟
+  bool needsTime() const { return needsTime_; }
+
+  void formatPrefix(LogStream &stream, const Context &context) const {
+    if (cachePrefix_) {
+      runCachedPrefix(stream, context);
+    } else {
+      run(stream, context, prefix_);
+    }
+  }
+
+  // 使当前线程缓存的行首失效
+  static void invalidateThreadCache();
+
+  // 以 '\n' 结尾，不受正文长度上限限制
+  void formatSuffix(LogStream &stream, const Context &context) const {
+    run(stream, context, suffix_);
+  }
+
+private:
+  enum class OpCode : uint8_t {
+    kLiteral,
+    kDate,
+    kTime,
+    kDateTime, // 由 "%D %T" 合并而来
+    kMicros,
+    kMillis,
+    kTid,
+    kLevel,
+    kFile,
+    kLine,
+  };
+
+  struct Op {
+    OpCode code;
+    uint32_t offset; // kLiteral: 在 literals_ 中的位置
+    uint32_t length;
+  };
+
+  // %m 之前或之后的一段操作
+  struct Range {
+    size_t begin;
+    size_t end;
+    size_t maxLength; // 除源文件名之外输出的最大字节数
+    bool hasFile;
+    bool newline; // 以 '\n' 结尾
+  };
+
+  // 长度不超过该值的字面量按固定长度拷贝
+  static constexpr size_t kLiteralPadding = 16;
+
+  Range makeRange(size_t begin, size_t end, bool newline) const;
+
+  // 直接写入 stream 的缓冲区，每段只检查一次剩余空间
+  void run(LogStream &stream, const Context &context,
+           const Range &range) const;
+  __attribute__((noinline)) void runSlow(LogStream &stream,
+                                         const Context &context,
+                                         const Range &range,
+                                         size_t fileLength,
+                                         size_t maxLength) const;
+  // 写入 p 开始的空间，返回写入之后的位置
+  char *write(char *p, const Context &context, const Range &range,
+              size_t fileLength) const;
+
+  // 行首不含源文件名与行号时按线程缓存整段行首，同一秒内每行只需一次
+  // 定长拷贝，再改写微秒、级别等逐行变化的定宽字段
+  void runCachedPrefix(LogStream &stream, const Context &context) const;
+
+  std::vector<Op> ops_;
+  string literals_;
+  Range prefix_;
+  Range suffix_;
+  bool needsTime_;
+  bool cachePrefix_;
+  uint64_t version_; // 每次 compile() 都不同，用于判断线程缓存是否失效
+};
+} // namespace log
+
+#endif
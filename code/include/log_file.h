@@ -18,19 +18,66 @@
 #ifndef __LOG_FILE_H__
 #define __LOG_FILE_H__
 
+#include "append_file.h"
 #include "noncopyable.h"
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 
 namespace log {
+// 每个新日志文件开头写入的内容，如二进制日志的调用点定义
+using FileHeaderFunc = std::function<std::string()>;
+
+// 按时间回滚的周期，以 UTC 整点/零点为界
+enum class RollPeriod { kNone, kHourly, kDaily };
+
+// 回滚后旧文件的压缩方式
+enum class Compression { kNone, kGzip };
+
+struct LogFileOptions {
+  int flushInterval = 3; // 刷新周期，单位秒
+  FileHeaderFunc header;
+  WriteBackend backend = WriteBackend::kStdio;
+  bool directIO = false;
+  // false: 不加锁、不注册定时刷新，只能由一个线程使用并自行调用 flush()，
+  //        供 AsyncLogging 的后端线程使用
+  bool threadSafe = true;
+
+  // 写入超过 rollSize 或到达周期边界时回滚
+  RollPeriod rollPeriod = RollPeriod::kNone;
+  Compression compression = Compression::kNone;
+  // 写入时即以最快级别流式压缩，每次 flush 结束一个 gzip member，
+  // 文件名以 .log.gz 结尾；此时 rollSize 按压缩后的字节数计算
+  Compression streamCompression = Compression::kNone;
+  // 保留的已回滚文件个数与总字节数，0 表示不限制，超出时删除最旧的文件
+  size_t maxFiles = 0;
+  uint64_t maxTotalBytes = 0;
+};
+
+/**
+ * log file: 线程安全模式下由共享的 TimerService 定时刷新，
+ *           无论打开多少个日志文件，都不会额外创建线程
+ *           下一个文件由正常优先级的 BackgroundWorker::urgent() 提前创建，
+ *           回滚时只需改名并替换指针；旧文件的压缩与过期清理在低优先级的
+ *           BackgroundWorker 上进行
+ * */
 class LogFile {
   NOCOPYABLE_DECLARE(LogFile)
 
 public:
   LogFile(const std::string &basename, int rollSize, int flushInterval = 3);
+  LogFile(const std::string &basename, int rollSize,
+          const LogFileOptions &options);
   ~LogFile();
 
   void append(const char *logline, size_t len);
 
+  // 见 AppendFile::submit()，回滚文件时会等待之前提交的数据写完
+  void submit(const char *data, size_t len);
+  void wait();
+  bool pending();
+
   void flush();
 
 private:
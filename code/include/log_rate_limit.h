@@ -0,0 +1,105 @@
+/* =====================================================================================
+ *
+ *       Filename:  log_rate_limit.h
+ *
+ *    Description:  调用点的限流与采样状态
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __LOG_RATE_LIMIT_H__
+#define __LOG_RATE_LIMIT_H__
+
+#include "log_stream.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace log {
+
+// admit() 的结果: 这次调用是否输出，以及自上次输出以来被限流的次数
+struct LogAdmission {
+  bool admitted;
+  uint64_t suppressed;
+
+  explicit operator bool() const { return admitted; }
+};
+
+/**
+ * 以下状态由 LOG_EVERY_N / LOG_FIRST_N / LOG_EVERY_MS 在每个调用点定义为
+ * 静态变量，常量初始化，只使用原子变量而不加锁；参数在每次调用时传入
+ * */
+
+// 每 n 次调用输出一次: 第 1、n+1、2n+1... 次
+class LogEveryN {
+public:
+  LogAdmission admit(uint64_t n) {
+    uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+    if (n > 1 && count % n != 0) {
+      return {false, 0};
+    }
+    return {true, count == 0 || n <= 1 ? 0 : n - 1};
+  }
+
+private:
+  std::atomic<uint64_t> count_{0};
+};
+
+// 只输出前 n 次；此后不再有输出，被限流的次数也就无从报告
+class LogFirstN {
+public:
+  LogAdmission admit(uint64_t n) {
+    // 达到上限后只读不写，调用点所在的缓存行不再在线程间来回传递
+    if (count_.load(std::memory_order_relaxed) >= n) {
+      return {false, 0};
+    }
+    return {count_.fetch_add(1, std::memory_order_relaxed) < n, 0};
+  }
+
+private:
+  std::atomic<uint64_t> count_{0};
+};
+
+// 每 ms 毫秒至多输出一次，间隔以 steady_clock 计
+class LogEveryMs {
+public:
+  LogAdmission admit(int64_t ms) {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    int64_t next = next_.load(std::memory_order_relaxed);
+    // 同一时刻到期的多个线程中只有一个能推进 next_
+    if (now < next ||
+        !next_.compare_exchange_strong(next, now + ms * 1000000,
+                                       std::memory_order_relaxed)) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return {false, 0};
+    }
+    return {true, suppressed_.exchange(0, std::memory_order_relaxed)};
+  }
+
+private:
+  std::atomic<int64_t> next_{0};
+  std::atomic<uint64_t> suppressed_{0};
+};
+
+// 在输出的这一条日志中以字段 suppressed 记录此前被限流的次数
+inline LogStream &reportSuppressed(LogStream &stream,
+                                   const LogAdmission &admission) {
+  if (admission.suppressed > 0) {
+    stream.kv("suppressed", admission.suppressed);
+  }
+  return stream;
+}
+
+} // namespace log
+
+#endif
@@ -0,0 +1,72 @@
+/* =====================================================================================
+ *
+ *       Filename:  log_sink.h
+ *
+ *    Description:  日志的输出目标，由 SinkDispatcher 在各自的线程上调用
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __LOG_SINK_H__
+#define __LOG_SINK_H__
+
+#include "log_file.h"
+#include "noncopyable.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+
+namespace log {
+
+/**
+ * log sink: write() 与 flush() 只在该 sink 专属的线程上调用，无需加锁
+ * */
+class LogSink {
+public:
+  virtual ~LogSink() {}
+
+  // 一条完整的日志行，返回后 logline 即失效
+  virtual void write(const char *logline, size_t len) = 0;
+
+  virtual void flush() {}
+};
+
+// 写入回滚日志文件
+class FileSink : public LogSink {
+  NOCOPYABLE_DECLARE(FileSink)
+
+public:
+  FileSink(const std::string &basename, int rollSize,
+           LogFileOptions options = LogFileOptions());
+
+  void write(const char *logline, size_t len) override;
+  void flush() override;
+
+private:
+  std::unique_ptr<LogFile> file_;
+};
+
+// 写入 stdout/stderr 等已打开的 FILE
+class StreamSink : public LogSink {
+  NOCOPYABLE_DECLARE(StreamSink)
+
+public:
+  explicit StreamSink(FILE *stream) : stream_(stream) {}
+
+  void write(const char *logline, size_t len) override;
+  void flush() override;
+
+private:
+  FILE *stream_;
+};
+} // namespace log
+
+#endif
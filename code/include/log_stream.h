@@ -15,31 +15,147 @@
  * =====================================================================================
  */
 
-#ifndef __BUFFER_H__
+#ifndef __LOG_STREAM_H__
+#define __LOG_STREAM_H__
 
 #include "buffer.h"
 #include "noncopyable.h"
 #include "string_piece.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstring>
 #include <string>
+#include <type_traits>
 
 using std::string;
 
 namespace log {
 
+// "00" "01" ... "99"，整数格式化时每次转换两位数字
+extern const char kDigitPairs[];
+
+/**
+ * 日志行格式
+ * kText: 默认的文本格式，结构化字段以 " key=value" 追加在正文之后
+ * kLogfmt: time=... tid=... level=... msg="..." key=value file=... line=...
+ * kJson: 每行一个 JSON 对象，字段依次为 time、tid、level、msg、
+ *        结构化字段、file、line
+ */
+enum class LogFormat { kText, kLogfmt, kJson };
+
 /**
- * log stream: 内部采用固定缓冲区，大小为 kSmallBuffer = 4000 bytes
- *            注意不要输出过多字节到 LogStream对象中
+ * log buffer: 日志行缓冲区。先写入对象内 kInlineBuffer 字节的空间，放不下时
+ *            转移到线程局部的溢出区并按需扩容，因此常见的短日志只涉及少量
+ *            cache line，长日志也能完整保留；内容超过上限时截断，末尾追加
+ *            kTruncatedMarker（不计入上限），此后的写入被丢弃
+ * */
+class LogBuffer {
+  NOCOPYABLE_DECLARE(LogBuffer)
+
+public:
+  static constexpr size_t kInlineBuffer = 512;
+  static constexpr char kTruncatedMarker[] = "...(truncated)";
+  static constexpr size_t kTruncatedMarkerLength = sizeof kTruncatedMarker - 1;
+
+  // limit: 内容的字节数上限，不小于 kInlineBuffer
+  explicit LogBuffer(size_t limit)
+      : data_(inline_), cur_(inline_), end_(inline_ + kInlineBuffer),
+        capacity_(kInlineBuffer), limit_(limit), maxLength_(limit),
+        truncated_(false) {}
+  ~LogBuffer() {
+    if (data_ != inline_) {
+      releaseSpill();
+    }
+  }
+
+  // append
+  void append(const char *msg, size_t len) {
+    if (static_cast<size_t>(end_ - cur_) >= len) {
+      memcpy(cur_, msg, len);
+      cur_ += len;
+    } else {
+      appendSlow(msg, len);
+    }
+  }
+
+  // 保证 current() 之后至少有 len 字节可写，写入后以 add() 提交；
+  // 超过上限时返回 nullptr
+  char *ensure(size_t len) {
+    return static_cast<size_t>(end_ - cur_) >= len ? cur_ : ensureSlow(len);
+  }
+
+  // data
+  const char *data() const { return data_; }
+  size_t length() const { return cur_ - data_; }
+  char *current() const { return cur_; }
+
+  // write to data_ directly
+  char *current() { return cur_; }
+  // 当前存储空间中剩余的字节数，不超过上限
+  int avail() const { return static_cast<int>(end_ - cur_); }
+  void add(size_t len) { cur_ += len; }
+
+  // 达到上限之前还能写入的字节数
+  size_t room() const { return truncated_ ? 0 : limit_ - length(); }
+  bool truncated() const { return truncated_; }
+  // 截断到 len 字节并清除截断状态
+  void truncate(size_t len);
+  // 写入截断标记，此后的写入被丢弃
+  void markTruncated();
+  // 在当前内容之后再允许写入 len 字节并清除截断状态，用于正文之后的行尾
+  void extendLimit(size_t len);
+  // 此后的写入全部丢弃，但不写入截断标记；用于截断后已补全语法的 JSON 字段
+  void seal() {
+    truncated_ = true;
+    updateEnd();
+  }
+
+  // reset: 溢出区归还给当前线程，上限恢复为构造时的值
+  void reset() {
+    if (data_ != inline_) {
+      releaseSpill();
+    }
+    cur_ = data_;
+    limit_ = maxLength_;
+    truncated_ = false;
+    updateEnd();
+  }
+
+  // to string
+  string toString() const { return string(data_, length()); }
+  StringPiece toStringPiece() const { return StringPiece(data_, length()); }
+
+private:
+  void appendSlow(const char *msg, size_t len);
+  char *ensureSlow(size_t len);
+  // 存储空间扩大到至少 len 字节，内存不足时返回 false
+  bool grow(size_t len);
+  void releaseSpill();
+  void updateEnd() {
+    end_ = truncated_ ? cur_ : data_ + std::min(capacity_, limit_);
+  }
+
+  char *data_;
+  char *cur_;
+  char *end_; // 不截断时为存储空间与上限中较小的一处，截断后等于 cur_
+  size_t capacity_;
+  size_t limit_;
+  size_t maxLength_;
+  bool truncated_;
+  char inline_[kInlineBuffer];
+};
+
+/**
+ * log stream: 缓冲区见 LogBuffer，单条日志的正文不超过 maxMessageSize()
  * */
 class LogStream {
   NOCOPYABLE_DECLARE(LogStream)
   using self = LogStream;
 
 public:
-  using Buffer = FixedBuffer<kSmallBuffer>;
+  using Buffer = LogBuffer;
 
-  LogStream() = default;
+  LogStream() : buffer_(maxMessageSize_), fields_(maxMessageSize_) {}
 
   self &operator<<(bool v) {
     buffer_.append(v ? "1" : "0", 1);
@@ -100,18 +216,94 @@ public:
     return *this;
   }
 
+  /**
+   * 结构化字段: 按 setFieldFormat() 指定的格式写入单独的字段缓冲区，
+   *            由 Logger 在日志行结束时追加到正文之后，可与 << 混用，如
+   *            LOG_INFO.kv("user", id).kv("latency_us", t) << "done";
+   *            value 可以是整数、浮点数、bool 与字符串
+   */
+  template <typename T> self &kv(StringPiece key, const T &value) {
+    beginField(key);
+    if constexpr (std::is_same<T, bool>::value) {
+      fieldBool(value);
+    } else if constexpr (std::is_integral<T>::value &&
+                         std::is_signed<T>::value) {
+      fieldInteger(static_cast<long long>(value));
+    } else if constexpr (std::is_integral<T>::value) {
+      fieldInteger(static_cast<unsigned long long>(value));
+    } else if constexpr (std::is_floating_point<T>::value) {
+      fieldDouble(static_cast<double>(value));
+    } else {
+      fieldString(StringPiece(value));
+    }
+    return *this;
+  }
+
+  void setFieldFormat(LogFormat format) { format_ = format; }
+  const Buffer &fields() const { return fields_; }
+
+  // 按 JSON 字符串规则转义后追加，并为之后的内容至少保留 reserve 字节
+  void appendEscaped(const char *data, size_t len, size_t reserve = 0);
+
+  // 将 offset 之后已写入的内容按 JSON 字符串规则原地转义，
+  // 无需转义时只扫描一次，不做任何拷贝
+  void escapeFrom(size_t offset);
+
+  // 正文结束，之后追加的 len 字节行尾不受正文长度上限限制
+  void finishMessage(size_t len) { buffer_.extendLimit(len); }
+
+  /**
+   * 单条日志正文（含结构化字段）的字节数上限，默认 kDefaultMaxMessageSize，
+   * 超出部分被丢弃并以 LogBuffer::kTruncatedMarker 标记；
+   * 不小于 LogBuffer::kInlineBuffer，只影响之后构造或 resetBuffer() 的 LogStream
+   */
+  static constexpr size_t kDefaultMaxMessageSize = 64 * 1024;
+  static void setMaxMessageSize(size_t size);
+  static size_t maxMessageSize() { return maxMessageSize_; }
+
+  /**
+   * 浮点数输出精度: 0（默认）输出能精确还原的最短表示，
+   *               1~17 按 "%.<precision>g" 输出有效数字
+   */
+  static void setDoublePrecision(int precision);
+  static int doublePrecision() { return doublePrecision_; }
+
   void append(const char *data, int len) { buffer_.append(data, len); }
+
+  // 至少有 len 字节可写时返回写入位置，写入后以 commit() 提交，否则返回 nullptr
+  char *reserve(size_t len) { return buffer_.ensure(len); }
+  void commit(size_t len) { buffer_.add(len); }
   const Buffer &buffer() const { return buffer_; }
-  void resetBuffer() { buffer_.reset(); }
+  void resetBuffer() {
+    buffer_.reset();
+    fields_.reset();
+  }
 
 private:
   void staticCheck();
 
   template <typename T> void formatInteger(T);
+  // 由 format(p) 在 p 处写入至多 kMaxNumericSize 字节并返回写入的长度
+  template <typename Format>
+  static void appendFormatted(Buffer &buffer, Format &&format);
+
+  void beginField(StringPiece key);
+  void fieldBool(bool v);
+  void fieldInteger(long long v);
+  void fieldInteger(unsigned long long v);
+  void fieldDouble(double v);
+  void fieldString(StringPiece v);
 
   Buffer buffer_;
+  Buffer fields_;
+  LogFormat format_ = LogFormat::kText;
 
   static const int kMaxNumericSize = 48;
+  // JSON 字段的键之后: '"'、':' 与一个数值
+  static const int kJsonFieldReserve = 2 + kMaxNumericSize;
+  static constexpr int kMaxDoublePrecision = 17;
+  static int doublePrecision_;
+  static size_t maxMessageSize_;
 };
 } // namespace log
 #endif
\ No newline at end of file
@@ -14,10 +14,16 @@
  *
  * =====================================================================================
  */
+
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
 #include "log_stream.h"
 #include <cinttypes>
+#include <ctime>
 #include <functional>
 #include <memory>
+#include <type_traits>
 
 namespace log {
 /**
@@ -33,6 +39,34 @@ enum class LogLevel : unsigned long {
   NUM_LOG_LEVELS,
 };
 
+// 各日志级别在日志行中的名称，长度均为 6
+extern const char *LogLevelName[];
+
+// 将时间格式化为 "YYYY-MM-DD HH:MM:SS.uuuuuu(UTC)"，返回写入的字节数
+// buf 至少 64 字节；日期时间部分按线程缓存，同一秒内只格式化一次
+int formatLogTime(char *buf, time_t seconds, int microseconds);
+
+/**
+ * 时间戳的时钟源
+ * kRealtime: CLOCK_REALTIME，微秒精度
+ * kRealtimeCoarse: CLOCK_REALTIME_COARSE，毫秒级精度，但读取开销更低
+ * kTsc: 以 CLOCK_REALTIME 校准的 TSC，微秒精度，每条日志只读一次 rdtsc，
+ *       见 tsc_clock.h；不支持时退化为 kRealtime
+ */
+enum class ClockSource {
+  kRealtime,
+  kRealtimeCoarse,
+  kTsc,
+};
+
+// 按 setClockSource() 选择的时钟读取当前时间（自 1970 年起的纳秒数），
+// 同时记为调用线程当前日志的时间戳
+int64_t readLogClock();
+
+// 取出并清除调用线程当前日志的时间戳，未读取过时钟时返回 0；
+// 供按时间戳归并各线程日志的输出端使用，如 AsyncLogging::setReorderWindow()
+int64_t takeRecordTime();
+
 /**
  * 日志输出器: 输出格式按照如下格式：
  *        日期     时间     微秒    线程   级别   正文    源文件: 行号
@@ -40,11 +74,70 @@ enum class LogLevel : unsigned long {
  */
 
 using OutputFunc = std::function<void(const char *, int)>;
+// 同时传递日志级别的输出函数，供按级别过滤或丢弃日志的输出端使用
+using LevelOutputFunc = std::function<void(const char *, int, LogLevel)>;
 using FlushFunc = std::function<void()>;
+// 不经过 std::function 的输出函数，context 为设置时传入的指针
+using RawOutputFunc = void (*)(void *context, const char *msg, int len,
+                               LogLevel level);
+
+/**
+ * 链接期绑定的输出端: 每条日志结束时调用 logOutput()，FATAL 日志随后调用
+ * logFlush()。库中的默认实现为弱符号，按 Logger::setOutput()/setFlush()
+ * 的设置分发；应用程序在 namespace log 中定义同名函数即可在链接期替换，
+ * 每条日志直接调用，此时 setOutput()/setFlush() 不再生效
+ */
+void logOutput(const char *msg, int len, LogLevel level);
+void logFlush();
+
+/**
+ * 源文件名: 只保留路径中最后一个 '/' 之后的部分。
+ * 经 LOG_SOURCE_FILE 构造时，位置与长度都在编译期求出，运行时没有开销
+ */
+class SourceFile {
+public:
+  template <size_t N, size_t Offset>
+  constexpr SourceFile(const char (&path)[N],
+                       std::integral_constant<size_t, Offset>)
+      : data_(path + Offset), size_(static_cast<int>(N - 1 - Offset)) {
+    static_assert(Offset < N, "invalid basename offset");
+  }
+
+  // 运行时传入的路径，每次构造查找一次 '/'
+  explicit SourceFile(const char *path);
+
+  // 最后一个 '/' 之后的位置，没有 '/' 时为 0
+  static constexpr size_t basenameOffset(const char *path) {
+    size_t offset = 0;
+    for (size_t i = 0; path[i] != '\0'; ++i) {
+      if (path[i] == '/') {
+        offset = i + 1;
+      }
+    }
+    return offset;
+  }
+
+  constexpr const char *data() const { return data_; }
+  constexpr int size() const { return size_; }
+
+private:
+  const char *data_;
+  int size_;
+};
+
+// 作为模板实参，保证 basenameOffset() 在编译期求值
+#define LOG_SOURCE_FILE                                                        \
+  ::log::SourceFile(__FILE__,                                                  \
+                    std::integral_constant<size_t,                             \
+                        ::log::SourceFile::basenameOffset(__FILE__)>())
+
+class LinePattern;
 class Logger {
+  NOCOPYABLE_DECLARE(Logger)
+
 public:
-  Logger(const char *file, int line, LogLevel level);
-  Logger(const char *file, int line, LogLevel level, const char *func);
+  Logger(SourceFile file, int line, LogLevel level);
+  Logger(SourceFile file, int line, LogLevel level, const char *func);
   ~Logger();
 
   LogStream &stream();
@@ -52,12 +145,40 @@ public:
   static LogLevel getLogLevel();
   static void setLogLevel(LogLevel level);
 
+  // 日志行格式，默认为 kText；只影响 LOG_* 宏，LOG_FMT 的二进制记录不受影响
+  static void setFormat(LogFormat format);
+
+  // kText 格式的行布局，见 line_pattern.h；需在输出日志之前调用，
+  // pattern 无效时返回 false，原有的布局保持不变
+  static bool setPattern(const char *pattern);
+  static const LinePattern &pattern();
+
+  // 输出端以原子指针发布，可以在其它线程输出日志的同时调用
   static void setOutput(OutputFunc);
+  static void setOutput(LevelOutputFunc);
+  static void setOutput(RawOutputFunc out, void *context);
   static void setFlush(FlushFunc);
 
+  // 编译期绑定 sink 的成员函数，每条日志直接调用而不经过 std::function
+  // 如: Logger::setOutput<&AsyncLogging::append>(&asyncLog);
+  template <auto Append, typename T> static void setOutput(T *sink) {
+    setOutput(&callMember<T, Append>, sink);
+  }
+
+  static void setClockSource(ClockSource source);
+
 private:
+  template <typename T, auto Append>
+  static void callMember(void *context, const char *msg, int len,
+                         LogLevel level) {
+    (static_cast<T *>(context)->*Append)(msg, len, level);
+  }
+
   class Impl;
-  std::unique_ptr<Impl> impl_;
+  // 指向当前线程复用的槽位，嵌套输出日志时才退化为堆分配
+  Impl *impl_;
 };
 
-} // namespace log
\ No newline at end of file
+} // namespace log
+
+#endif
@@ -15,26 +15,108 @@
  * =====================================================================================
  */
 
+#ifndef __LOGGING_H__
+#define __LOGGING_H__
+
+#include "log_rate_limit.h"
 #include "logger.h"
 
 namespace log {
 
 extern LogLevel getLogLevel();
 extern void setLogLevel(LogLevel level);
+extern void setFormat(LogFormat format);
+extern bool setPattern(const char *pattern);
 extern void setOutput(OutputFunc);
+extern void setOutput(LevelOutputFunc);
+extern void setOutput(RawOutputFunc out, void *context);
+template <auto Append, typename T> void setOutput(T *sink) {
+  Logger::setOutput<Append>(sink);
+}
 extern void setFlush(FlushFunc);
+extern void setClockSource(ClockSource source);
+
+/**
+ * 编译期日志级别: 低于 LOG_COMPILE_LEVEL 的 LOG_* 语句在编译期整体消除，
+ *               其参数表达式既不会被求值，也不会生成任何代码。
+ *               Release 构建（定义了 NDEBUG）默认消除 TRACE/DEBUG，
+ *               可通过 -DLOG_COMPILE_LEVEL=LOG_LEVEL_TRACE 等方式覆盖。
+ *               LOG_FATAL 始终保留。
+ */
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_FATAL 5
+
+#ifndef LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+#define LOG_LIKELY(x) __builtin_expect(!!(x), 1)
+#define LOG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+
+// 编译期条件为常量 false 时，else 分支为死代码，被编译器整体删除
+#define LOG_IF_LEVEL(level, expect)                                            \
+  if (!(LOG_COMPILE_LEVEL <= LOG_LEVEL_##level &&                              \
+        expect(getLogLevel() <= LogLevel::level))) {                           \
+  } else
+
+// 各级别的分支预测提示与 Logger，LOG_* 与限流的 LOG_EVERY_N 等共用；
+// TRACE/DEBUG 默认关闭，并额外记录函数名
+#define LOG_EXPECT_TRACE LOG_UNLIKELY
+#define LOG_EXPECT_DEBUG LOG_UNLIKELY
+#define LOG_EXPECT_INFO LOG_LIKELY
+#define LOG_EXPECT_WARN LOG_LIKELY
+#define LOG_EXPECT_ERROR LOG_LIKELY
+#define LOG_EXPECT_FATAL LOG_LIKELY
+
+#define LOG_LOGGER_TRACE                                                       \
+  Logger(LOG_SOURCE_FILE, __LINE__, LogLevel::TRACE, __func__)
+#define LOG_LOGGER_DEBUG                                                       \
+  Logger(LOG_SOURCE_FILE, __LINE__, LogLevel::DEBUG, __func__)
+#define LOG_LOGGER_INFO Logger(LOG_SOURCE_FILE, __LINE__, LogLevel::INFO)
+#define LOG_LOGGER_WARN Logger(LOG_SOURCE_FILE, __LINE__, LogLevel::WARN)
+#define LOG_LOGGER_ERROR Logger(LOG_SOURCE_FILE, __LINE__, LogLevel::ERROR)
+#define LOG_LOGGER_FATAL Logger(LOG_SOURCE_FILE, __LINE__, LogLevel::FATAL)
 
 #define LOG_TRACE                                                              \
-  if (getLogLevel() <= LogLevel::TRACE)                                        \
-  Logger(__FILE__, __LINE__, LogLevel::TRACE, __func__).stream()
+  LOG_IF_LEVEL(TRACE, LOG_EXPECT_TRACE) LOG_LOGGER_TRACE.stream()
 #define LOG_DEBUG                                                              \
-  if (getLogLevel() <= LogLevel::DEBUG)                                        \
-  Logger(__FILE__, __LINE__, LogLevel::DEBUG, __func__).stream()
+  LOG_IF_LEVEL(DEBUG, LOG_EXPECT_DEBUG) LOG_LOGGER_DEBUG.stream()
 #define LOG_INFO                                                               \
-  if (getLogLevel() <= LogLevel::INFO)                                         \
-  Logger(__FILE__, __LINE__, LogLevel::INFO).stream()
-#define LOG_WARN Logger(__FILE__, __LINE__, LogLevel::WARN).stream()
-#define LOG_ERROR Logger(__FILE__, __LINE__, LogLevel::ERROR).stream()
-#define LOG_FATAL Logger(__FILE__, __LINE__, LogLevel::FATAL).stream()
+  LOG_IF_LEVEL(INFO, LOG_EXPECT_INFO) LOG_LOGGER_INFO.stream()
+#define LOG_WARN                                                               \
+  LOG_IF_LEVEL(WARN, LOG_EXPECT_WARN) LOG_LOGGER_WARN.stream()
+#define LOG_ERROR                                                              \
+  LOG_IF_LEVEL(ERROR, LOG_EXPECT_ERROR) LOG_LOGGER_ERROR.stream()
+#define LOG_FATAL LOG_LOGGER_FATAL.stream()
+
+/**
+ * 调用点限流: 被限流的调用只做一两次原子操作，不构造 Logger 与 LogStream，
+ *           也不求值 << 右侧的表达式；之后输出的第一条日志带有字段
+ *           suppressed=<此前被限流的次数>。级别过滤规则与 LOG_* 相同
+ * LOG_EVERY_N(INFO, 1000) << ...: 每 1000 次调用输出一次
+ * LOG_FIRST_N(WARN, 10) << ...: 只输出前 10 次
+ * LOG_EVERY_MS(WARN, 100) << ...: 每 100 毫秒至多输出一次
+ */
+#define LOG_RATE_LIMITED(level, Limit, arg)                                    \
+  LOG_IF_LEVEL(level, LOG_EXPECT_##level)                                      \
+  if (static ::log::Limit logLimit_; false) {                                  \
+  } else if (::log::LogAdmission logAdmission_ = logLimit_.admit(arg);         \
+             !logAdmission_) {                                                 \
+  } else                                                                       \
+    ::log::reportSuppressed(LOG_LOGGER_##level.stream(), logAdmission_)
+
+#define LOG_EVERY_N(level, n) LOG_RATE_LIMITED(level, LogEveryN, n)
+#define LOG_FIRST_N(level, n) LOG_RATE_LIMITED(level, LogFirstN, n)
+#define LOG_EVERY_MS(level, ms) LOG_RATE_LIMITED(level, LogEveryMs, ms)
+
+} // namespace log
 
-} // namespace log
\ No newline at end of file
+#endif
@@ -0,0 +1,56 @@
+/* =====================================================================================
+ *
+ *       Filename:  mapped_file.h
+ *
+ *    Description:  基于 mmap 的日志文件，预分配空间后直接拷贝到映射区
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include "noncopyable.h"
+#include <memory>
+#include <string>
+
+namespace log {
+
+/**
+ * mapped file: 每次 fallocate 并映射 segmentSize 字节，append() 只是一次 memcpy
+ *              flush() 以 msync(MS_ASYNC) 交给内核回写，
+ *              已回写过的页用 madvise 释放，常驻内存不随文件增长
+ *              关闭时截断到实际写入的字节数；进程崩溃时文件末尾会留有
+ *              预分配的空字节
+ * */
+class MappedFile {
+  NOCOPYABLE_DECLARE(MappedFile)
+
+public:
+  MappedFile(const std::string &filename, size_t segmentSize);
+  ~MappedFile();
+
+  // 打开或映射失败时返回 false
+  bool valid() const;
+
+  void append(const char *logline, size_t len);
+
+  void flush();
+
+  size_t writtenBytes() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+} // namespace log
+
+#endif
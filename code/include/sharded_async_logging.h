@@ -0,0 +1,96 @@
+/* =====================================================================================
+ *
+ *       Filename:  sharded_async_logging.h
+ *
+ *    Description:  分片的异步日志输出器
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __SHARDED_ASYNC_LOGGING_H__
+#define __SHARDED_ASYNC_LOGGING_H__
+
+#include "async_logging.h"
+#include "noncopyable.h"
+#include "string_piece.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace log {
+
+/**
+ * sharded async logging: 由 N 个相互独立的 AsyncLogging 组成，每个分片有
+ *                        自己的前端缓冲区、后端线程与日志文件，
+ *                        文件名为 basename.<分片序号>；生产者按线程或按类别
+ *                        映射到分片，写入与刷盘的吞吐随分片数扩展。
+ *                        同一线程（或同一类别）的日志总在同一分片中，保持有序；
+ *                        分片之间的日志可由 log_merge 按时间戳合并
+ * */
+class ShardedAsyncLogging {
+  NOCOPYABLE_DECLARE(ShardedAsyncLogging);
+
+public:
+  ShardedAsyncLogging(const std::string &basename, size_t shards,
+                      int rollSize, int flushInterval = 3);
+  ~ShardedAsyncLogging();
+
+  size_t shards() const;
+  // 直接访问某个分片，如单独设置某个分片的写入方式
+  AsyncLogging &shard(size_t index);
+
+  // 以下设置作用于所有分片，含义见 AsyncLogging，需在 start() 之前调用
+  void setFrontEnd(AsyncLogging::FrontEnd frontEnd,
+                   size_t ringSize = AsyncLogging::kDefaultRingSize);
+  void setRecordFormat(AsyncLogging::RecordFormat format);
+  void setWriteBackend(WriteBackend backend, bool directIO = false);
+  void setRolling(RollPeriod period,
+                  Compression compression = Compression::kNone,
+                  size_t maxFiles = 0, uint64_t maxTotalBytes = 0);
+  void setStreamCompression(Compression compression);
+  void setBufferPool(size_t buffers, bool lockMemory = false,
+                     bool hugePages = false);
+  void setOverloadPolicy(AsyncLogging::OverloadPolicy policy,
+                         LogLevel keepLevel = LogLevel::WARN,
+                         uint32_t sampleRate = 100);
+  void setStatsInterval(int seconds);
+  void setReorderWindow(int milliseconds);
+
+  // 按调用线程选择分片: 线程第一次输出时依次分配，此后固定不变
+  void append(const char *logline, size_t len,
+              LogLevel level = LogLevel::INFO);
+  void appendRecord(const char *record, size_t len,
+                    LogLevel level = LogLevel::INFO);
+
+  // 按类别的哈希值选择分片
+  void appendTo(StringPiece category, const char *logline, size_t len,
+                LogLevel level = LogLevel::INFO);
+
+  // 调用线程或类别对应的分片序号
+  size_t shardOfThread() const;
+  size_t shardOf(StringPiece category) const;
+
+  // 所有分片的丢弃统计之和
+  AsyncLogging::DropStats dropStats() const;
+  // 所有分片的运行统计，计数之和，max* 取各分片的最大值
+  AsyncLogging::Stats stats() const;
+
+  void start();
+
+  void stop();
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+} // namespace log
+
+#endif
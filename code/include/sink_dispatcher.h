@@ -0,0 +1,70 @@
+/* =====================================================================================
+ *
+ *       Filename:  sink_dispatcher.h
+ *
+ *    Description:  将一条日志分发到多个 sink，每个 sink 有独立的级别与异步队列
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __SINK_DISPATCHER_H__
+#define __SINK_DISPATCHER_H__
+
+#include "log_sink.h"
+#include "logger.h"
+#include "noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace log {
+
+/**
+ * sink dispatcher: 前端格式化好的日志行只拷贝一次，写入引用计数的共享块，
+ *                  各个级别匹配的 sink 的队列中只保存指向该块的引用；
+ *                  每个 sink 由自己的线程写出，队列积压超过上限时
+ *                  只丢弃该 sink 的日志，不会拖慢其它 sink 与前端
+ * */
+class SinkDispatcher {
+  NOCOPYABLE_DECLARE(SinkDispatcher)
+
+public:
+  static constexpr size_t kDefaultQueueBytes = 64 * 1024 * 1024;
+
+  explicit SinkDispatcher(int flushInterval = 3);
+  ~SinkDispatcher();
+
+  // 需在 start() 之前调用，返回值为该 sink 的序号
+  // level: 低于该级别的日志不会进入此 sink
+  // maxQueueBytes: 尚未写出的日志字节数上限；队列中的日志使其所在的共享块
+  //                无法复用，引用的块数也以此为上限（每块 1MB，至少 2 块）
+  size_t addSink(std::shared_ptr<LogSink> sink,
+                 LogLevel level = LogLevel::TRACE,
+                 size_t maxQueueBytes = kDefaultQueueBytes);
+
+  // 可直接作为 Logger::setOutput() 的 LevelOutputFunc
+  void append(const char *logline, size_t len, LogLevel level);
+
+  // 序号为 index 的 sink 因队列积压而丢弃的日志条数
+  uint64_t droppedMessages(size_t index) const;
+
+  void start();
+
+  // 写出所有 sink 中剩余的日志后返回
+  void stop();
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+} // namespace log
+
+#endif
@@ -0,0 +1,221 @@
+/* =====================================================================================
+ *
+ *       Filename:  staging_ring.h
+ *
+ *    Description:  单生产者单消费者的字节环形缓冲区，用作每个前端线程的暂存区
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __STAGING_RING_H__
+#define __STAGING_RING_H__
+
+#include "noncopyable.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace log {
+
+/**
+ * staging ring: 生产者只写 head_，消费者只写 tail_，两者均无锁
+ *               write() 要么写入整条日志，要么什么都不写，
+ *               因此 [tail_, head_) 区间内始终是完整的日志行；
+ *               以 writeStamped() 写入时每条记录带有时间戳头部，
+ *               消费者可逐条取出，在多个环形缓冲区之间按时间戳归并
+ * */
+class StagingRing {
+  NOCOPYABLE_DECLARE(StagingRing)
+
+public:
+  explicit StagingRing(size_t capacity)
+      : capacity_(roundUpPowerOfTwo(capacity)), mask_(capacity_ - 1),
+        data_(new char[capacity_]), head_(0), cachedTail_(0), records_(0),
+        lastStamp_(0), tail_(0), closed_(false) {}
+
+  // producer: 空间不足时返回 false
+  bool write(const char *msg, size_t len) {
+    return write(nullptr, 0, msg, len);
+  }
+
+  // producer: 将 prefix 与 msg 作为一条日志写入
+  bool write(const char *prefix, size_t prefixLen, const char *msg,
+             size_t len) {
+    return write(nullptr, 0, prefix, prefixLen, msg, len);
+  }
+
+  // producer: 写入带时间戳的一条记录，供消费者以 peekStamp()/pop()
+  //           按记录读取；同一环形缓冲区中不可与 write() 混用
+  bool writeStamped(int64_t stamp, const char *prefix, size_t prefixLen,
+                    const char *msg, size_t len) {
+    char header[kStampHeaderSize];
+    uint32_t n = static_cast<uint32_t>(prefixLen + len);
+    memcpy(header, &stamp, sizeof stamp);
+    memcpy(header + sizeof stamp, &n, sizeof n);
+    if (!write(header, sizeof header, prefix, prefixLen, msg, len)) {
+      return false;
+    }
+    lastStamp_.store(stamp, std::memory_order_release);
+    return true;
+  }
+
+  // producer: 当前已占用的字节数（近似值，只会偏大）
+  size_t used() const {
+    return head_.load(std::memory_order_relaxed) - cachedTail_;
+  }
+
+  // producer: 重新读取消费者进度后的已占用字节数
+  size_t refreshUsed() {
+    cachedTail_ = tail_.load(std::memory_order_acquire);
+    return used();
+  }
+
+  // consumer: 以至多两段连续内存的形式取出全部可读数据，返回取出的字节数
+  template <typename Func> size_t drain(Func &&func) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t len = head - tail;
+    if (len == 0) {
+      return 0;
+    }
+    size_t offset = tail & mask_;
+    size_t first = std::min(len, capacity_ - offset);
+    func(data_.get() + offset, first);
+    if (len > first) {
+      func(data_.get(), len - first);
+    }
+    tail_.store(head, std::memory_order_release);
+    return len;
+  }
+
+  // consumer: 下一条带时间戳记录的时间戳，没有可读的记录时返回 false
+  bool peekStamp(int64_t *stamp) const {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    copyOut(tail, reinterpret_cast<char *>(stamp), sizeof *stamp);
+    return true;
+  }
+
+  // consumer: 取出下一条带时间戳的记录，正文以至多两段连续内存交给 func，
+  //           返回正文的字节数；须先由 peekStamp() 确认有可读的记录
+  template <typename Func> size_t pop(Func &&func) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t len;
+    copyOut(tail + sizeof(int64_t), reinterpret_cast<char *>(&len),
+            sizeof len);
+    size_t offset = (tail + kStampHeaderSize) & mask_;
+    size_t first = std::min<size_t>(len, capacity_ - offset);
+    func(data_.get() + offset, first);
+    if (len > first) {
+      func(data_.get(), len - first);
+    }
+    tail_.store(tail + kStampHeaderSize + len, std::memory_order_release);
+    return len;
+  }
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return capacity_; }
+
+  // consumer: 生产者最近写入的一条记录的时间戳，尚未写入时为 0。
+  //           同一线程的时间戳单调不减，此后写入的记录不会早于它，
+  //           读取之后 peekStamp() 一定能看到这条记录
+  int64_t lastStamp() const {
+    return lastStamp_.load(std::memory_order_acquire);
+  }
+
+  // 自创建以来写入的日志条数与字节数（含带时间戳记录的头部），
+  // 可在任意线程读取
+  uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+  uint64_t bytesWritten() const {
+    return head_.load(std::memory_order_relaxed);
+  }
+
+  // 生产者线程退出时关闭，消费者排空后即可回收
+  void close() { closed_.store(true, std::memory_order_release); }
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+  // 带时间戳记录的头部: int64_t 时间戳 + uint32_t 正文长度
+  static constexpr size_t kStampHeaderSize = sizeof(int64_t) + sizeof(uint32_t);
+
+private:
+  bool write(const char *header, size_t headerLen, const char *prefix,
+             size_t prefixLen, const char *msg, size_t len) {
+    size_t total = headerLen + prefixLen + len;
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (capacity_ - (head - cachedTail_) < total) {
+      cachedTail_ = tail_.load(std::memory_order_acquire);
+      if (capacity_ - (head - cachedTail_) < total) {
+        return false;
+      }
+    }
+    copyIn(head, header, headerLen);
+    copyIn(head + headerLen, prefix, prefixLen);
+    copyIn(head + headerLen + prefixLen, msg, len);
+    head_.store(head + total, std::memory_order_release);
+    // 只有生产者写入，无需原子的读-改-写
+    records_.store(records_.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+    return true;
+  }
+
+  void copyIn(size_t pos, const char *msg, size_t len) {
+    if (len == 0) {
+      return;
+    }
+    size_t offset = pos & mask_;
+    size_t first = std::min(len, capacity_ - offset);
+    memcpy(data_.get() + offset, msg, first);
+    memcpy(data_.get(), msg + first, len - first);
+  }
+
+  void copyOut(size_t pos, char *out, size_t len) const {
+    size_t offset = pos & mask_;
+    size_t first = std::min(len, capacity_ - offset);
+    memcpy(out, data_.get() + offset, first);
+    memcpy(out + first, data_.get(), len - first);
+  }
+
+  static size_t roundUpPowerOfTwo(size_t n) {
+    size_t size = 4096;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+private:
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<char[]> data_;
+
+  // producer 独占的缓存行
+  alignas(64) std::atomic<size_t> head_;
+  size_t cachedTail_;
+  std::atomic<uint64_t> records_;
+  std::atomic<int64_t> lastStamp_;
+
+  // consumer 独占的缓存行
+  alignas(64) std::atomic<size_t> tail_;
+  std::atomic<bool> closed_;
+};
+
+} // namespace log
+
+#endif
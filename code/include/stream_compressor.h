@@ -0,0 +1,59 @@
+/* =====================================================================================
+ *
+ *       Filename:  stream_compressor.h
+ *
+ *    Description:  流式压缩日志，输出由若干 gzip member 首尾相接组成，
+ *                  可直接用 zcat/gzip -d 解压
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __STREAM_COMPRESSOR_H__
+#define __STREAM_COMPRESSOR_H__
+
+#include "noncopyable.h"
+#include <functional>
+#include <memory>
+
+namespace log {
+
+/**
+ * stream compressor: compress() 的数据累积在当前 member 中，
+ *                    finish() 结束当前 member 并输出其余部分，
+ *                    因此每次 flush 之后文件都是完整可解压的
+ * */
+class StreamCompressor {
+  NOCOPYABLE_DECLARE(StreamCompressor)
+
+public:
+  // 压缩后的数据块交给 output，返回后即可复用
+  using OutputFunc = std::function<void(const char *, size_t)>;
+
+  // level: zlib 压缩级别，1 最快
+  StreamCompressor(int level, OutputFunc output);
+  ~StreamCompressor();
+
+  void compress(const char *data, size_t len);
+
+  // 没有未结束的 member 时什么也不做
+  void finish();
+
+  // 累计输入与输出的字节数
+  size_t inputBytes() const;
+  size_t outputBytes() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+} // namespace log
+
+#endif
@@ -0,0 +1,53 @@
+/* =====================================================================================
+ *
+ *       Filename:  timer_service.h
+ *
+ *    Description:  进程内共享的周期定时器，所有独立使用的 LogFile 共用一个线程刷新
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __TIMER_SERVICE_H__
+#define __TIMER_SERVICE_H__
+
+#include "noncopyable.h"
+#include "singleton.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace log {
+
+/**
+ * timer service: 首次 add() 时启动唯一的定时线程，回调在该线程上执行，
+ *                因此回调应当短小且不能调用 add()/remove()
+ * */
+class TimerService {
+  NOCOPYABLE_DECLARE(TimerService)
+  SINGLETON_PATTERN_DECLARE(TimerService)
+
+public:
+  using TimerId = uint64_t;
+  using TimerFunc = std::function<void()>;
+
+  // 每隔 intervalSeconds 秒调用一次 func
+  TimerId add(int intervalSeconds, TimerFunc func);
+
+  // 返回后 func 不会再被调用，若正在执行则等待其结束
+  void remove(TimerId id);
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+} // namespace log
+
+#endif
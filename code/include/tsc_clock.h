@@ -0,0 +1,44 @@
+/* =====================================================================================
+ *
+ *       Filename:  tsc_clock.h
+ *
+ *    Description:  以 CLOCK_REALTIME 校准的 TSC 时钟
+ *
+ *        Version:  1.0
+ *        Created:
+ *       Revision:  none
+ *       Compiler:
+ *
+ *         Author:
+ *        Company:
+ *
+ * =====================================================================================
+ */
+
+#ifndef __TSC_CLOCK_H__
+#define __TSC_CLOCK_H__
+
+#include <cstdint>
+
+namespace log {
+
+/**
+ * tsc clock: 每次读取只执行一次 rdtsc 与一次乘法，不进入 vDSO。
+ *            首次使用时以 CLOCK_MONOTONIC 测量 TSC 频率（约 10ms），
+ *            此后每个线程约每秒以 CLOCK_REALTIME 重新对齐一次，并以更长的
+ *            基线细化频率，因此能跟随 NTP 的调整；同一线程读到的时间单调不减
+ *            （系统时间被回调超过 1ms 时除外）。
+ *            CPU 不支持恒定频率的 TSC（或非 x86）时退化为 clock_gettime
+ * */
+namespace tscclock {
+
+// 是否使用 TSC，否则 now() 直接读取 CLOCK_REALTIME
+bool available();
+
+// 自 1970-01-01 UTC 起的纳秒数
+int64_t now();
+
+} // namespace tscclock
+} // namespace log
+
+#endif
@@ -1,41 +1,248 @@
 #include "append_file.h"
+#include "mapped_file.h"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
 #include <iostream>
+#include <linux/io_uring.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
 
 namespace log {
 
 constexpr int32_t FILE_BUFS_IZE = 64 * 1024;
 
+namespace {
+constexpr size_t kDirectAlignment = 4096;
+constexpr size_t kDirectBufferSize = 1024 * 1024;
+constexpr unsigned kUringEntries = 64;
+
+// 写完整个区间，失败时输出到终端并放弃剩余部分
+void pwriteAll(int fd, const char *data, size_t len, off_t offset) {
+  while (len > 0) {
+    ssize_t n = ::pwrite(fd, data, len, offset);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "AppendFile: pwrite failed: %s\n", strerror(errno));
+      return;
+    }
+    data += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+/**
+ * io uring: 只提交 IORING_OP_WRITE 的最小封装，直接使用系统调用
+ *           提交队列只由一个线程使用，因此无需加锁
+ * */
+class IoUring {
+  NOCOPYABLE_DECLARE(IoUring)
+
+public:
+  // entries 为 0 时不创建
+  explicit IoUring(unsigned entries) : fd_(-1), unsubmitted_(0) {
+    if (entries == 0) {
+      return;
+    }
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      return;
+    }
+    sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    singleMmap_ = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap_) {
+      sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sq_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_ = singleMmap_
+              ? sq_
+              : mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes == MAP_FAILED) {
+      if (sqes != MAP_FAILED) {
+        munmap(sqes, sqesSize_);
+      }
+      unmapRings();
+      ::close(fd_);
+      fd_ = -1;
+      return;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    sqHead_ = field<std::atomic<unsigned>>(sq_, params.sq_off.head);
+    sqTail_ = field<std::atomic<unsigned>>(sq_, params.sq_off.tail);
+    sqMask_ = *field<unsigned>(sq_, params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = field<unsigned>(sq_, params.sq_off.array);
+
+    cqHead_ = field<std::atomic<unsigned>>(cq_, params.cq_off.head);
+    cqTail_ = field<std::atomic<unsigned>>(cq_, params.cq_off.tail);
+    cqMask_ = *field<unsigned>(cq_, params.cq_off.ring_mask);
+    cqes_ = field<io_uring_cqe>(cq_, params.cq_off.cqes);
+  }
+
+  ~IoUring() {
+    if (fd_ >= 0) {
+      munmap(sqes_, sqesSize_);
+      unmapRings();
+      ::close(fd_);
+    }
+  }
+
+  bool valid() const { return fd_ >= 0; }
+
+  // 提交队列已满时返回 false
+  bool write(int fd, const char *data, size_t len, off_t offset,
+             uint64_t userData) {
+    unsigned tail = sqTail_->load(std::memory_order_relaxed);
+    if (tail - sqHead_->load(std::memory_order_acquire) == sqEntries_) {
+      return false;
+    }
+    unsigned index = tail & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = static_cast<uint32_t>(len);
+    sqe->off = static_cast<uint64_t>(offset);
+    sqe->user_data = userData;
+    sqArray_[index] = index;
+    sqTail_->store(tail + 1, std::memory_order_release);
+    ++unsubmitted_;
+    return true;
+  }
+
+  // 提交尚未提交的请求，并至少等待 minComplete 个完成事件
+  void enter(unsigned minComplete) {
+    for (;;) {
+      int ret = static_cast<int>(
+          syscall(__NR_io_uring_enter, fd_, unsubmitted_, minComplete,
+                  minComplete > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+      if (ret >= 0) {
+        unsubmitted_ -= std::min<unsigned>(ret, unsubmitted_);
+        return;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        fprintf(stderr, "AppendFile: io_uring_enter failed: %s\n",
+                strerror(errno));
+        return;
+      }
+    }
+  }
+
+  // 依次处理已完成的请求，返回处理的个数
+  template <typename Func> unsigned reap(Func &&func) {
+    unsigned head = cqHead_->load(std::memory_order_relaxed);
+    unsigned tail = cqTail_->load(std::memory_order_acquire);
+    unsigned count = 0;
+    for (; head != tail; ++head, ++count) {
+      const io_uring_cqe &cqe = cqes_[head & cqMask_];
+      func(cqe.user_data, cqe.res);
+    }
+    cqHead_->store(head, std::memory_order_release);
+    return count;
+  }
+
+private:
+  // 内核映射的环形队列中位于 offset 处的字段
+  template <typename T> static T *field(void *ring, uint32_t offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+  }
+
+  void unmapRings() {
+    if (sq_ != MAP_FAILED) {
+      munmap(sq_, sqSize_);
+    }
+    if (!singleMmap_ && cq_ != MAP_FAILED) {
+      munmap(cq_, cqSize_);
+    }
+  }
+
+  int fd_;
+  unsigned unsubmitted_;
+  bool singleMmap_ = false;
+  size_t sqSize_ = 0;
+  size_t cqSize_ = 0;
+  size_t sqesSize_ = 0;
+  void *sq_ = MAP_FAILED;
+  void *cq_ = MAP_FAILED;
+  io_uring_sqe *sqes_ = nullptr;
+  std::atomic<unsigned> *sqHead_ = nullptr;
+  std::atomic<unsigned> *sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned sqEntries_ = 0;
+  unsigned *sqArray_ = nullptr;
+  std::atomic<unsigned> *cqHead_ = nullptr;
+  std::atomic<unsigned> *cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+};
+} // namespace
+
 class AppendFile::Impl {
 public:
-  Impl(const string &filename);
-  ~Impl();
+  Impl() : writtenBytes_(0) {}
+  virtual ~Impl() {}
+
+  virtual void append(const char *logline, size_t len) = 0;
 
-  void append(const char *logline, size_t len);
+  virtual void submit(const char *data, size_t len) { append(data, len); }
+  virtual void wait() {}
+  virtual bool pending() { return false; }
 
-  void flush();
+  virtual void flush() = 0;
 
-  size_t writtenBytes() const;
+  size_t writtenBytes() const { return writtenBytes_; }
+
+protected:
+  size_t writtenBytes_;
+};
+
+class AppendFile::StdioFile : public AppendFile::Impl {
+public:
+  StdioFile(const string &filename);
+  ~StdioFile() override;
+
+  void append(const char *logline, size_t len) override;
+
+  void flush() override;
 
 private:
   FILE *fp_;
   char buffer_[FILE_BUFS_IZE];
-  size_t writtenBytes_;
 };
 
-AppendFile::Impl::Impl(const string &filename) : writtenBytes_(0) {
+AppendFile::StdioFile::StdioFile(const string &filename) {
   fp_ = fopen(filename.c_str(), "ae");
   assert(fp_ != nullptr);
   setbuffer(fp_, buffer_, sizeof buffer_);
 }
 
-AppendFile::Impl::~Impl() {
+AppendFile::StdioFile::~StdioFile() {
   flush();
   fclose(fp_);
 }
 
-void AppendFile::Impl::append(const char *logline, size_t len) {
+void AppendFile::StdioFile::append(const char *logline, size_t len) {
   size_t n = fwrite_unlocked(logline, 1, len, fp_);
   if (n != len) {
     fprintf(stderr, "AppendFile::append() failed\n");
@@ -43,20 +250,329 @@ void AppendFile::Impl::append(const char *logline, size_t len) {
   writtenBytes_ += n;
 }
 
-void AppendFile::Impl::flush() { fflush(fp_); }
+void AppendFile::StdioFile::flush() { fflush(fp_); }
+
+/**
+ * descriptor file: 自行维护写入偏移，以 pwrite/pwritev 写入指定位置，
+ *                  因此异步写入的请求之间无需保序
+ *                  directIO 模式下，对齐缓冲区中未写满一页的尾部在 flush()
+ *                  时经普通描述符写入，并保留在缓冲区中，
+ *                  写满后再以 O_DIRECT 整块覆盖
+ * */
+class AppendFile::DescriptorFile : public AppendFile::Impl {
+public:
+  DescriptorFile(const string &filename, bool useUring, bool directIO);
+  ~DescriptorFile() override;
+
+  // io_uring 不可用时返回 false
+  bool valid() const { return fd_ >= 0 && (!useUring_ || uring_.valid()); }
+
+  void append(const char *logline, size_t len) override;
+  void submit(const char *data, size_t len) override;
+  void wait() override;
+  bool pending() override;
+  void flush() override;
+
+private:
+  struct Write {
+    const char *data;
+    size_t len;
+    off_t offset;
+  };
+
+  void writeBuffered(); // 写出 buffer_ 中合并的小块数据
+  void writeAsync(int fd, const char *data, size_t len, off_t offset);
+  void complete(uint64_t slot, int res);
 
-size_t AppendFile::Impl::writtenBytes() const { return writtenBytes_; }
+  void appendDirect(const char *data, size_t len);
+  void writeDirectBuffer();
 
-AppendFile::AppendFile(const string &filename)
-    : impl_(std::make_unique<Impl>(filename)) {}
+  const bool useUring_;
+  int fd_;
+  off_t offset_; // 下一次写入的文件偏移
+  IoUring uring_;
+  std::vector<Write> writes_; // 正在进行的异步写入，下标为 user_data
+  std::vector<uint64_t> freeSlots_;
+  size_t inFlight_;
+  size_t bufferLen_;
+  char buffer_[FILE_BUFS_IZE];
+
+  // directIO 模式
+  int directFd_;
+  char *aligned_[2]; // 双缓冲，一块异步写入时另一块继续拷贝
+  bool alignedBusy_[2];
+  int current_;
+  size_t alignedLen_;
+};
+
+AppendFile::DescriptorFile::DescriptorFile(const string &filename,
+                                           bool useUring, bool directIO)
+    : useUring_(useUring), fd_(-1), offset_(0),
+      uring_(useUring ? kUringEntries : 0), inFlight_(0), bufferLen_(0),
+      directFd_(-1), aligned_{nullptr, nullptr}, alignedBusy_{false, false},
+      current_(0),
+      alignedLen_(0) {
+  // directIO 模式下需要读回文件末尾不足一页的部分
+  fd_ = ::open(filename.c_str(),
+               (directIO ? O_RDWR : O_WRONLY) | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    fprintf(stderr, "AppendFile: open %s failed: %s\n", filename.c_str(),
+            strerror(errno));
+    return;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) == 0) {
+    offset_ = st.st_size;
+  }
+  if (!directIO) {
+    return;
+  }
+  directFd_ = ::open(filename.c_str(), O_WRONLY | O_CLOEXEC | O_DIRECT);
+  if (directFd_ < 0) {
+    fprintf(stderr, "AppendFile: O_DIRECT unsupported for %s: %s\n",
+            filename.c_str(), strerror(errno));
+    return;
+  }
+  for (char *&buffer : aligned_) {
+    void *p = nullptr;
+    if (posix_memalign(&p, kDirectAlignment, kDirectBufferSize) != 0) {
+      fprintf(stderr, "AppendFile: posix_memalign failed\n");
+      abort();
+    }
+    buffer = static_cast<char *>(p);
+  }
+  // 已有文件的末尾不足一页时，读回这部分使对齐缓冲区从页边界开始
+  alignedLen_ = offset_ % kDirectAlignment;
+  offset_ -= alignedLen_;
+  if (alignedLen_ > 0 &&
+      ::pread(fd_, aligned_[0], alignedLen_, offset_) !=
+          static_cast<ssize_t>(alignedLen_)) {
+    fprintf(stderr, "AppendFile: pread failed: %s\n", strerror(errno));
+  }
+}
+
+AppendFile::DescriptorFile::~DescriptorFile() {
+  if (fd_ >= 0) {
+    wait();
+    flush();
+    ::close(fd_);
+  }
+  if (directFd_ >= 0) {
+    ::close(directFd_);
+  }
+  free(aligned_[0]);
+  free(aligned_[1]);
+}
+
+void AppendFile::DescriptorFile::append(const char *logline, size_t len) {
+  writtenBytes_ += len;
+  if (directFd_ >= 0) {
+    appendDirect(logline, len);
+    return;
+  }
+  if (bufferLen_ + len <= sizeof buffer_) {
+    memcpy(buffer_ + bufferLen_, logline, len);
+    bufferLen_ += len;
+    return;
+  }
+  // 大块数据不再拷贝，与缓冲区中的数据一起 pwritev
+  iovec vec[2] = {{buffer_, bufferLen_},
+                  {const_cast<char *>(logline), len}};
+  size_t total = bufferLen_ + len;
+  ssize_t n = ::pwritev(fd_, vec, 2, offset_);
+  if (n < 0) {
+    n = 0;
+  }
+  if (static_cast<size_t>(n) < total) {
+    // 短写时补写剩余部分
+    size_t done = n;
+    if (done < bufferLen_) {
+      pwriteAll(fd_, buffer_ + done, bufferLen_ - done, offset_ + done);
+      done = bufferLen_;
+    }
+    pwriteAll(fd_, logline + (done - bufferLen_), total - done,
+              offset_ + done);
+  }
+  offset_ += total;
+  bufferLen_ = 0;
+}
+
+void AppendFile::DescriptorFile::submit(const char *data, size_t len) {
+  if (!useUring_ || directFd_ >= 0) {
+    append(data, len);
+    return;
+  }
+  // 先写出合并的小块数据，使 buffer_ 不会处于异步写入中
+  writeBuffered();
+  writeAsync(fd_, data, len, offset_);
+  offset_ += len;
+  writtenBytes_ += len;
+}
+
+void AppendFile::DescriptorFile::wait() {
+  while (inFlight_ > 0) {
+    uring_.enter(1);
+    uring_.reap([this](uint64_t slot, int res) { complete(slot, res); });
+  }
+}
+
+bool AppendFile::DescriptorFile::pending() {
+  if (inFlight_ > 0) {
+    uring_.reap([this](uint64_t slot, int res) { complete(slot, res); });
+  }
+  return inFlight_ > 0;
+}
+
+void AppendFile::DescriptorFile::flush() {
+  if (directFd_ >= 0) {
+    // 尾部经页缓存写入，保留在缓冲区中，写满一整块后再以 O_DIRECT 覆盖
+    wait();
+    pwriteAll(fd_, aligned_[current_], alignedLen_, offset_);
+    return;
+  }
+  writeBuffered();
+}
+
+void AppendFile::DescriptorFile::writeBuffered() {
+  if (bufferLen_ > 0) {
+    pwriteAll(fd_, buffer_, bufferLen_, offset_);
+    offset_ += bufferLen_;
+    bufferLen_ = 0;
+  }
+}
+
+void AppendFile::DescriptorFile::writeAsync(int fd, const char *data,
+                                            size_t len, off_t offset) {
+  uint64_t slot;
+  if (freeSlots_.empty()) {
+    slot = writes_.size();
+    writes_.push_back({});
+  } else {
+    slot = freeSlots_.back();
+    freeSlots_.pop_back();
+  }
+  writes_[slot] = {data, len, offset};
+  while (!uring_.write(fd, data, len, offset, slot)) {
+    // 提交队列已满，等待一部分请求完成
+    uring_.enter(1);
+    uring_.reap([this](uint64_t s, int res) { complete(s, res); });
+  }
+  ++inFlight_;
+  uring_.enter(0);
+}
+
+void AppendFile::DescriptorFile::complete(uint64_t slot, int res) {
+  Write &write = writes_[slot];
+  size_t done = res > 0 ? static_cast<size_t>(res) : 0;
+  if (res < 0 && res != -EAGAIN && res != -EINTR) {
+    fprintf(stderr, "AppendFile: io_uring write failed: %s\n", strerror(-res));
+  }
+  if (done < write.len) {
+    // 短写或失败时同步补写，O_DIRECT 的剩余部分不再对齐，改用普通描述符
+    pwriteAll(fd_, write.data + done, write.len - done, write.offset + done);
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (write.data == aligned_[i]) {
+      alignedBusy_[i] = false;
+    }
+  }
+  freeSlots_.push_back(slot);
+  --inFlight_;
+}
+
+void AppendFile::DescriptorFile::appendDirect(const char *data, size_t len) {
+  while (len > 0) {
+    size_t n = std::min(len, kDirectBufferSize - alignedLen_);
+    memcpy(aligned_[current_] + alignedLen_, data, n);
+    alignedLen_ += n;
+    data += n;
+    len -= n;
+    if (alignedLen_ == kDirectBufferSize) {
+      writeDirectBuffer();
+    }
+  }
+}
+
+void AppendFile::DescriptorFile::writeDirectBuffer() {
+  const char *buffer = aligned_[current_];
+  if (useUring_) {
+    alignedBusy_[current_] = true;
+    writeAsync(directFd_, buffer, kDirectBufferSize, offset_);
+    // 另一块缓冲区可能仍在写入中，切换之前等待其完成
+    current_ ^= 1;
+    while (alignedBusy_[current_]) {
+      uring_.enter(1);
+      uring_.reap([this](uint64_t slot, int res) { complete(slot, res); });
+    }
+  } else {
+    ssize_t n = ::pwrite(directFd_, buffer, kDirectBufferSize, offset_);
+    size_t done = n > 0 ? static_cast<size_t>(n) : 0;
+    if (done < kDirectBufferSize) {
+      pwriteAll(fd_, buffer + done, kDirectBufferSize - done, offset_ + done);
+    }
+  }
+  offset_ += kDirectBufferSize;
+  alignedLen_ = 0;
+}
+
+class AppendFile::MappedImpl : public AppendFile::Impl {
+public:
+  MappedImpl(const string &filename, size_t segmentSize)
+      : file_(filename, segmentSize) {}
+
+  bool valid() const { return file_.valid(); }
+
+  void append(const char *logline, size_t len) override {
+    file_.append(logline, len);
+    writtenBytes_ += len;
+  }
+
+  void flush() override { file_.flush(); }
+
+private:
+  MappedFile file_;
+};
+
+AppendFile::AppendFile(const string &filename, WriteBackend backend,
+                       bool directIO, size_t segmentSize) {
+  if (backend == WriteBackend::kMmap) {
+    auto file = std::make_unique<MappedImpl>(filename, segmentSize);
+    if (file->valid()) {
+      impl_ = std::move(file);
+      return;
+    }
+    fprintf(stderr, "AppendFile: mmap unavailable, fall back to stdio\n");
+  } else if (backend != WriteBackend::kStdio) {
+    auto file = std::make_unique<DescriptorFile>(
+        filename, backend == WriteBackend::kIoUring, directIO);
+    if (file->valid()) {
+      impl_ = std::move(file);
+      return;
+    }
+    static std::atomic<bool> warned(false);
+    if (!warned.exchange(true)) {
+      fprintf(stderr, "AppendFile: %s unavailable, fall back to stdio\n",
+              backend == WriteBackend::kIoUring ? "io_uring" : "writev");
+    }
+  }
+  impl_ = std::make_unique<StdioFile>(filename);
+}
 AppendFile::~AppendFile() {}
 
 void AppendFile::append(const char *logline, size_t len) {
   impl_->append(logline, len);
 }
 
+void AppendFile::submit(const char *data, size_t len) {
+  impl_->submit(data, len);
+}
+
+void AppendFile::wait() { impl_->wait(); }
+
+bool AppendFile::pending() { return impl_->pending(); }
+
 void AppendFile::flush() { impl_->flush(); }
 
 size_t AppendFile::writtenBytes() const { return impl_->writtenBytes(); }
 
-} // namespace log
\ No newline at end of file
+} // namespace log
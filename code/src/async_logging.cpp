@@ -1,10 +1,17 @@
 #include "async_logging.h"
+#include "binary_decoder.h"
+#include "binary_logging.h"
 #include "buffer.h"
+#include "buffer_pool.h"
 #include "log_file.h"
 #include "mutex_macro.h"
+#include "staging_ring.h"
+#include <algorithm>
 #include <assert.h>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <mutex>
 #include <string>
@@ -12,11 +19,61 @@
 #include <vector>
 
 #define GUARDED_BY(x) __attribute__((guarded_by(x)))
-constexpr int NUM_BUFFERS = 16;
-constexpr int NUM_DROP_BUFFERS_THRESHOLD = 25;
 
 namespace log {
 
+namespace {
+// 每个 AsyncLogging 实例的唯一编号，用于查找线程局部的环形缓冲区
+std::atomic<uint64_t> g_nextInstanceId(1);
+
+struct LocalRing {
+  uint64_t owner;
+  std::shared_ptr<StagingRing> ring;
+};
+
+// 线程退出时关闭本线程的所有环形缓冲区，由后端线程排空后回收
+struct LocalRings {
+  ~LocalRings() {
+    for (auto &local : rings) {
+      local.ring->close();
+    }
+  }
+  std::vector<LocalRing> rings;
+};
+
+thread_local LocalRings t_localRings;
+
+constexpr size_t kNumLevels = AsyncLogging::DropStats::kNumLevels;
+
+// 只由一个线程写入（或在锁内写入）的计数器，无需原子的读-改-写
+inline void addCounter(std::atomic<uint64_t> &counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+inline void maxCounter(std::atomic<uint64_t> &counter, uint64_t value) {
+  if (value > counter.load(std::memory_order_relaxed)) {
+    counter.store(value, std::memory_order_relaxed);
+  }
+}
+
+// 日志的时间戳；行布局中不含时间时 Logger 不读取时钟，在此补读
+inline int64_t recordTime() {
+  int64_t stamp = takeRecordTime();
+  if (stamp == 0) {
+    readLogClock();
+    stamp = takeRecordTime();
+  }
+  return stamp;
+}
+
+inline uint64_t nowNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+} // namespace
+
 class AsyncLogging::Impl {
 public:
   Impl(const string &basename, int rollSize, int flushInterval = 3);
@@ -25,30 +82,182 @@ public:
     if (running_) {
       stop();
     }
+    for (auto &ring : rings_) {
+      ring->close();
+    }
   }
 
-  void append(const char *logline, size_t len);
+  void setFrontEnd(FrontEnd frontEnd, size_t ringSize) {
+    frontEnd_ = frontEnd;
+    ringSize_ = ringSize;
+  }
+
+  void setRecordFormat(RecordFormat format) { format_ = format; }
+
+  void setWriteBackend(WriteBackend backend, bool directIO) {
+    backend_ = backend;
+    directIO_ = directIO;
+  }
+
+  void setRolling(RollPeriod period, Compression compression, size_t maxFiles,
+                  uint64_t maxTotalBytes) {
+    rollPeriod_ = period;
+    compression_ = compression;
+    maxFiles_ = maxFiles;
+    maxTotalBytes_ = maxTotalBytes;
+  }
+
+  void setStreamCompression(Compression compression) {
+    streamCompression_ = compression;
+  }
+
+  void setBufferPool(size_t buffers, bool lockMemory, bool hugePages) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    assert(buffers_.empty());
+    currentBuffer_ = nullptr;
+    pool_.reset();
+    pool_ = std::make_unique<BufferPool<Buffer>>(std::max<size_t>(buffers, 2),
+                                                 lockMemory, hugePages);
+    currentBuffer_ = pool_->acquire();
+    buffers_.reserve(pool_->capacity());
+    reserve_ = std::max<size_t>(pool_->capacity() / 4, 1);
+  }
+
+  void setOverloadPolicy(OverloadPolicy policy, LogLevel keepLevel,
+                         uint32_t sampleRate) {
+    policy_ = policy;
+    keepLevel_ = keepLevel;
+    sampleRate_ = std::max<uint32_t>(sampleRate, 1);
+  }
+
+  void append(const char *logline, size_t len, LogLevel level) {
+    if (format_ == RecordFormat::kText) {
+      write(nullptr, 0, logline, len, level);
+    } else {
+      char header[binary::kRecordHeaderSize];
+      binary::encodeRecordHeader(header,
+                                 static_cast<uint32_t>(sizeof header + len),
+                                 binary::kTextSite);
+      write(header, sizeof header, logline, len, level);
+    }
+  }
+
+  void appendRecord(const char *record, size_t len, LogLevel level);
+
+  Stats stats();
+
+  void setStatsInterval(int seconds) { statsInterval_ = seconds; }
+
+  void setReorderWindow(int milliseconds) {
+    reorderWindow_ = std::max(milliseconds, 0);
+  }
+
+  DropStats dropStats() const {
+    DropStats stats;
+    for (size_t i = 0; i < kNumLevels; ++i) {
+      stats.messages[i] = droppedMessages_[i].load(std::memory_order_relaxed);
+      stats.bytes[i] = droppedBytes_[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+  }
 
   void start() {
     thread_ = std::thread([&]() {
       running_ = true;
-      threadFunc();
+      if (frontEnd_ == FrontEnd::kThreadLocal) {
+        threadFuncLocal();
+      } else {
+        threadFunc();
+      }
     });
   }
 
   void stop() {
     running_ = false;
+    {
+      // 阻塞的生产者在 mutex_ 下检查 running_ 后才等待，不会错过通知
+      std::lock_guard<std::mutex> guard(mutex_);
+    }
     cond_.notify_one();
+    poolCond_.notify_all();
+    drainCond_.notify_all();
     thread_.join();
   }
 
 private:
+  void write(const char *prefix, size_t prefixLen, const char *logline,
+             size_t len, LogLevel level) {
+    if (frontEnd_ == FrontEnd::kThreadLocal) {
+      appendLocal(prefix, prefixLen, logline, len, level);
+    } else {
+      appendShared(prefix, prefixLen, logline, len, level);
+    }
+  }
+
+  void appendShared(const char *prefix, size_t prefixLen, const char *logline,
+                    size_t len, LogLevel level);
   void threadFunc();
 
-  using Buffer = FixedBuffer<kLargeBuffer>;
-  using BufferVector = std::vector<std::unique_ptr<Buffer>>;
+  StagingRing *localRing();
+  void appendLocal(const char *prefix, size_t prefixLen, const char *logline,
+                   size_t len, LogLevel level);
+  void threadFuncLocal();
+  // 后端线程: 按时间戳归并 rings，写出不晚于 cutoff 的记录，
+  // 返回写出的字节数，*held 表示是否有记录留到下一轮
+  size_t merge(LogFile &file,
+               const std::vector<std::shared_ptr<StagingRing>> &rings,
+               int64_t cutoff, bool *held);
+  int64_t reorderCutoff(
+      const std::vector<std::shared_ptr<StagingRing>> &rings);
+
+  // 后端线程: 按记录格式写入日志文件
+  LogFileOptions fileOptions();
+  void output(LogFile &file, const char *data, size_t len);
+  void outputText(LogFile &file, const char *text, size_t len);
+  void defineSites(LogFile &file);
+  string siteTable();
+
+  // 过载处理
+  bool shed(LogLevel level);        // 空间紧张时是否主动丢弃这条日志
+  bool shouldBlock(LogLevel level); // 空间耗尽时是否阻塞等待
+  void recordDrop(LogLevel level, size_t bytes) {
+    size_t i = static_cast<size_t>(level);
+    droppedMessages_[i].fetch_add(1, std::memory_order_relaxed);
+    droppedBytes_[i].fetch_add(bytes, std::memory_order_relaxed);
+  }
+  // 后端线程: 有新的丢弃时输出到终端和日志文件
+  void reportDrops(LogFile &file, uint64_t *reported);
+  // 后端线程: 每隔 statsInterval_ 秒将统计写入日志文件，force 时立即写入
+  void reportStats(LogFile &file, uint64_t *lastReport, bool force);
+  // 后端线程: 记录一轮写出的字节数与耗时
+  void recordBatch(uint64_t bytes, uint64_t writeNanos, uint64_t flushNanos);
+
+  // 额外记录各级别的日志条数与字节数，整块丢弃时据此统计
+  struct Buffer : FixedBuffer<kLargeBuffer> {
+    Buffer() { resetCounts(); }
+
+    void count(LogLevel level, size_t len) {
+      ++messages[static_cast<size_t>(level)];
+      bytes[static_cast<size_t>(level)] += len;
+    }
+    void reset() {
+      FixedBuffer<kLargeBuffer>::reset();
+      resetCounts();
+    }
+    void resetCounts() {
+      memset(messages, 0, sizeof messages);
+      memset(bytes, 0, sizeof bytes);
+    }
+
+    uint32_t messages[kNumLevels];
+    uint64_t bytes[kNumLevels];
+  };
+  using BufferVector = std::vector<Buffer *>; // 缓冲区归 pool_ 所有
   using BufferPtr = BufferVector::value_type;
 
+  // 提交后缓冲区可能仍在异步写入中，见 LogFile::submit()
+  void submit(LogFile &file, const Buffer *buffer);
+
   const int flushInterval_; // 刷新周期
   std::atomic<bool> running_;
   const string basename_;
@@ -56,50 +265,223 @@ private:
   std::thread thread_;
   std::mutex mutex_;
   std::condition_variable cond_ GUARDED_BY(mutex_);
+  std::condition_variable poolCond_ GUARDED_BY(mutex_); // 后端归还了缓冲区
+  std::condition_variable drainCond_ GUARDED_BY(mutex_); // 后端排空了环形缓冲区
+  std::unique_ptr<BufferPool<Buffer>> pool_ GUARDED_BY(mutex_);
+  size_t reserve_; // 池中空闲缓冲区不多于此数时视为空间紧张
   BufferPtr currentBuffer_ GUARDED_BY(mutex_);
-  BufferPtr nextBuffer_ GUARDED_BY(mutex_);
   BufferVector buffers_ GUARDED_BY(mutex_);
+
+  // 过载策略与各级别被丢弃的日志统计
+  OverloadPolicy policy_;
+  LogLevel keepLevel_;
+  uint32_t sampleRate_;
+  std::atomic<uint32_t> sampled_; // kSample 模式下低级别日志的计数
+  std::atomic<uint64_t> droppedMessages_[kNumLevels];
+  std::atomic<uint64_t> droppedBytes_[kNumLevels];
+
+  // 运行统计，见 AsyncLogging::Stats；写入时大多持有 mutex_ 或只有一个线程
+  // 写入，只有等待的计数在竞争路径上使用 fetch_add
+  struct Counters {
+    std::atomic<uint64_t> appendedMessages{0}; // kShared 模式，mutex_ 内写入
+    std::atomic<uint64_t> appendedBytes{0};
+    std::atomic<uint64_t> retiredMessages{0}; // 已回收的环形缓冲区，同上
+    std::atomic<uint64_t> retiredBytes{0};
+    std::atomic<uint64_t> bufferSwaps{0};
+    std::atomic<uint64_t> lockWaits{0};
+    std::atomic<uint64_t> lockWaitNanos{0};
+    std::atomic<uint64_t> bufferWaits{0};
+    std::atomic<uint64_t> bufferWaitNanos{0};
+    // 以下只由后端线程写入
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> batchBytes{0};
+    std::atomic<uint64_t> maxBatchBytes{0};
+    std::atomic<uint64_t> writeNanos{0};
+    std::atomic<uint64_t> maxWriteNanos{0};
+    std::atomic<uint64_t> flushes{0};
+    std::atomic<uint64_t> flushNanos{0};
+    std::atomic<uint64_t> maxFlushNanos{0};
+  };
+  Counters counters_;
+  int statsInterval_;
+
+  // kThreadLocal 模式
+  FrontEnd frontEnd_;
+  size_t ringSize_;
+  const uint64_t id_;
+  std::atomic<bool> pending_; // 有环形缓冲区超过半满，等待后端排空
+  std::vector<std::shared_ptr<StagingRing>> rings_ GUARDED_BY(mutex_);
+  int reorderWindow_; // 毫秒，0 表示不排序
+  std::vector<std::pair<int64_t, size_t>> mergeHeap_; // 仅后端线程访问
+
+  WriteBackend backend_;
+  bool directIO_;
+  RollPeriod rollPeriod_;
+  Compression compression_;
+  size_t maxFiles_;
+  uint64_t maxTotalBytes_;
+  Compression streamCompression_;
+
+  // 二进制记录格式，以下成员仅由后端线程访问
+  RecordFormat format_;
+  BinaryDecoder decoder_;
+  string decoded_;
+  string staging_;
+  uint32_t definedSites_; // 当前日志文件中已写入定义的调用点个数
 };
 
 AsyncLogging::Impl::Impl(const string &basename, int rollSize,
                          int flushInterval)
     : flushInterval_(flushInterval), running_(false), basename_(basename),
-      rollSize_(rollSize), currentBuffer_(new Buffer), nextBuffer_(new Buffer) {
-  currentBuffer_->bzero();
-  nextBuffer_->bzero();
-  buffers_.reserve(NUM_BUFFERS);
+      rollSize_(rollSize),
+      pool_(std::make_unique<BufferPool<Buffer>>(kDefaultPoolSize, false,
+                                                 false)),
+      reserve_(std::max<size_t>(kDefaultPoolSize / 4, 1)),
+      currentBuffer_(pool_->acquire()), policy_(OverloadPolicy::kDropNewest),
+      keepLevel_(LogLevel::WARN), sampleRate_(100), sampled_(0),
+      statsInterval_(0), frontEnd_(FrontEnd::kShared),
+      ringSize_(kDefaultRingSize), id_(g_nextInstanceId++), pending_(false),
+      reorderWindow_(0),
+      backend_(WriteBackend::kStdio), directIO_(false),
+      rollPeriod_(RollPeriod::kNone), compression_(Compression::kNone),
+      maxFiles_(0), maxTotalBytes_(0), streamCompression_(Compression::kNone),
+      format_(RecordFormat::kText), decoder_(true), definedSites_(0) {
+  buffers_.reserve(pool_->capacity());
+  for (size_t i = 0; i < kNumLevels; ++i) {
+    droppedMessages_[i] = 0;
+    droppedBytes_[i] = 0;
+  }
 }
 
-void AsyncLogging::Impl::append(const char *logline, size_t len) {
-  std::lock_guard<std::mutex> guard(mutex_);
-  assert(currentBuffer_ != nullptr);
-  if (currentBuffer_->avail() > len) {
-    currentBuffer_->append(logline, len);
-  } else {
-    buffers_.push_back(std::move(currentBuffer_));
+void AsyncLogging::Impl::appendRecord(const char *record, size_t len,
+                                      LogLevel level) {
+  if (format_ != RecordFormat::kText) {
+    write(nullptr, 0, record, len, level);
+    return;
+  }
+  thread_local BinaryDecoder t_decoder(true);
+  thread_local string t_decoded;
+  t_decoded.clear();
+  t_decoder.decode(record, len, &t_decoded);
+  write(nullptr, 0, t_decoded.data(), t_decoded.size(), level);
+}
 
-    if (nextBuffer_) {
-      currentBuffer_ = std::move(nextBuffer_);
-    } else {
-      currentBuffer_.reset(new Buffer);
-    }
+bool AsyncLogging::Impl::shed(LogLevel level) {
+  switch (policy_) {
+  case OverloadPolicy::kDropByLevel:
+    return level < keepLevel_;
+  case OverloadPolicy::kSample:
+    return level < keepLevel_ &&
+           sampled_.fetch_add(1, std::memory_order_relaxed) % sampleRate_ != 0;
+  default:
+    return false;
+  }
+}
+
+bool AsyncLogging::Impl::shouldBlock(LogLevel level) {
+  switch (policy_) {
+  case OverloadPolicy::kBlock:
+    return true;
+  case OverloadPolicy::kDropByLevel:
+  case OverloadPolicy::kSample:
+    return level >= keepLevel_;
+  default:
+    return false;
+  }
+}
 
-    currentBuffer_->append(logline, len);
+void AsyncLogging::Impl::appendShared(const char *prefix, size_t prefixLen,
+                                      const char *logline, size_t len,
+                                      LogLevel level) {
+  const size_t total = prefixLen + len;
+  std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    // 只在发生竞争时计时
+    uint64_t start = nowNanos();
+    lock.lock();
+    counters_.lockWaits.fetch_add(1, std::memory_order_relaxed);
+    counters_.lockWaitNanos.fetch_add(nowNanos() - start,
+                                      std::memory_order_relaxed);
+  }
+  assert(currentBuffer_ != nullptr);
+  // 空闲缓冲区所剩无几时先丢弃低级别日志，把空间留给高级别日志
+  if (pool_->available() <= reserve_ && shed(level)) {
+    recordDrop(level, total);
+    return;
+  }
+  while (currentBuffer_->avail() <= static_cast<int>(total)) {
+    // 当前缓冲区已满，交给后端线程并从池中换一块空的
+    BufferPtr next = pool_->acquire();
+    if (next == nullptr) {
+      if (shouldBlock(level) && running_) {
+        cond_.notify_one();
+        uint64_t start = nowNanos();
+        poolCond_.wait(lock);
+        addCounter(counters_.bufferWaits, 1);
+        addCounter(counters_.bufferWaitNanos, nowNanos() - start);
+        // 等待期间其他线程可能已经换过缓冲区，重新检查
+        continue;
+      }
+      if (policy_ == OverloadPolicy::kDropOldest && !buffers_.empty()) {
+        // 复用最早一块尚未交给后端线程的缓冲区
+        next = buffers_.front();
+        buffers_.erase(buffers_.begin());
+        for (size_t i = 0; i < kNumLevels; ++i) {
+          droppedMessages_[i].fetch_add(next->messages[i],
+                                        std::memory_order_relaxed);
+          droppedBytes_[i].fetch_add(next->bytes[i],
+                                     std::memory_order_relaxed);
+        }
+        next->reset();
+      } else {
+        recordDrop(level, total);
+        return;
+      }
+    }
+    buffers_.push_back(currentBuffer_);
+    currentBuffer_ = next;
+    addCounter(counters_.bufferSwaps, 1);
     cond_.notify_one();
   }
+  if (prefixLen > 0) {
+    currentBuffer_->append(prefix, prefixLen);
+  }
+  currentBuffer_->append(logline, len);
+  currentBuffer_->count(level, total);
+  addCounter(counters_.appendedMessages, 1);
+  addCounter(counters_.appendedBytes, total);
 }
 
 void AsyncLogging::Impl::threadFunc() {
-  LogFile output(basename_, rollSize_);
-
-  // 后备缓冲区
-  BufferPtr newBuffer1(new Buffer);
-  BufferPtr newBuffer2(new Buffer);
-  newBuffer1->bzero();
-  newBuffer2->bzero();
+  LogFile output(basename_, rollSize_, fileOptions());
 
   BufferVector buffersToWrite; // 与buffers_组成双缓冲
-  buffersToWrite.reserve(NUM_BUFFERS);
+  BufferVector buffersInFlight; // 已提交、可能仍在异步写入中的缓冲区
+  // 与 buffers_ 三者轮流交换，都预留容量，生产者 push_back 时不再分配内存
+  buffersToWrite.reserve(pool_->capacity());
+  buffersInFlight.reserve(pool_->capacity());
+  uint64_t reportedDrops = 0;
+  uint64_t lastStatsReport = nowNanos();
+
+  // 等待上一批写入完成后将其归还，唤醒等待缓冲区的生产者
+  auto releaseInFlight = [this, &buffersInFlight, &output](bool wait) {
+    if (buffersInFlight.empty()) {
+      return;
+    }
+    if (wait) {
+      output.wait();
+    } else if (output.pending()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      for (BufferPtr buffer : buffersInFlight) {
+        pool_->release(buffer);
+      }
+    }
+    poolCond_.notify_all();
+    buffersInFlight.clear();
+  };
 
   // 从 buffers_ 读取格式化后的日志
   while (running_) {
@@ -108,59 +490,561 @@ void AsyncLogging::Impl::threadFunc() {
       if (buffers_.empty()) {
         cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
       }
-      buffers_.push_back(std::move(currentBuffer_));
-      currentBuffer_ = std::move(newBuffer1);
-      buffersToWrite.swap(buffers_);
-      if (!nextBuffer_) {
-        nextBuffer_ = std::move(newBuffer2);
+      // 当前缓冲区中的日志也一并写出；池已耗尽时留到下一轮
+      if (currentBuffer_->length() > 0) {
+        BufferPtr fresh = pool_->acquire();
+        if (fresh != nullptr) {
+          buffers_.push_back(currentBuffer_);
+          currentBuffer_ = fresh;
+        }
       }
+      buffersToWrite.swap(buffers_);
     }
-    // 若日志输出太快，则丢弃部分日志
-    if (buffersToWrite.size() > NUM_DROP_BUFFERS_THRESHOLD) {
-      char buf[256] = {'\0'};
-      snprintf(buf, sizeof buf, "Drop log message %ld large buffers\n",
-               buffersToWrite.size() - 2);
-      // 同时输出到终端和日志文件
-      fputs(buf, stderr);
-      output.append(buf, strlen(buf));
-      // 仅保留前两个，用于保证前端的后备缓冲区
-      buffersToWrite.erase(buffersToWrite.begin() + 2, buffersToWrite.end());
+    uint64_t batchBytes = 0;
+    for (BufferPtr buffer : buffersToWrite) {
+      batchBytes += buffer->length();
     }
-    // 写日志文件
-    for (auto &buffer : buffersToWrite) {
-      output.append(buffer->data(), buffer->length());
+    uint64_t writeStart = nowNanos();
+    // 上一批在等待期间已在后台写入，确认完成后再提交这一批
+    releaseInFlight(true);
+    // 积压由缓冲区池的容量与过载策略约束，此处全部写出
+    reportDrops(output, &reportedDrops);
+    for (BufferPtr buffer : buffersToWrite) {
+      submit(output, buffer);
     }
+    buffersInFlight.swap(buffersToWrite);
+    // 同步写入的后端此时已经写完，立即归还
+    releaseInFlight(false);
+    uint64_t flushStart = nowNanos();
+    output.flush();
+    recordBatch(batchBytes, flushStart - writeStart, nowNanos() - flushStart);
+    reportStats(output, &lastStatsReport, false);
+  }
+  releaseInFlight(true);
 
-    // 更新newBuffer1、newBuffer2
-    if (buffersToWrite.size() > 2) {
-      buffersToWrite.resize(2);
+  // stop() 之后写出剩余的日志
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (BufferPtr buffer : buffers_) {
+      this->output(output, buffer->data(), buffer->length());
+      pool_->release(buffer);
     }
+    buffers_.clear();
+    this->output(output, currentBuffer_->data(), currentBuffer_->length());
+    currentBuffer_->reset();
+  }
+  reportDrops(output, &reportedDrops);
+  // stats() 需要获取 mutex_
+  reportStats(output, &lastStatsReport, true);
+  output.flush();
+}
 
-    if (!newBuffer1) {
-      newBuffer1 = std::move(buffersToWrite.back());
-      buffersToWrite.pop_back();
-      newBuffer1->reset();
+StagingRing *AsyncLogging::Impl::localRing() {
+  auto &locals = t_localRings.rings;
+  for (auto &local : locals) {
+    if (local.owner == id_) {
+      return local.ring.get();
     }
+  }
+  // 首次写入：清理已销毁实例遗留的缓冲区，再注册新的环形缓冲区
+  locals.erase(std::remove_if(locals.begin(), locals.end(),
+                              [](const LocalRing &local) {
+                                return local.ring->closed();
+                              }),
+               locals.end());
+  auto ring = std::make_shared<StagingRing>(ringSize_);
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    rings_.push_back(ring);
+  }
+  locals.push_back({id_, ring});
+  return ring.get();
+}
 
-    if (!newBuffer2) {
-      newBuffer2 = std::move(buffersToWrite.back());
-      buffersToWrite.pop_back();
-      newBuffer2->reset();
+void AsyncLogging::Impl::appendLocal(const char *prefix, size_t prefixLen,
+                                     const char *logline, size_t len,
+                                     LogLevel level) {
+  StagingRing *ring = localRing();
+  const bool stamped = reorderWindow_ > 0;
+  const int64_t stamp = stamped ? recordTime() : 0;
+  // 超过环形缓冲区容量的日志只能截断
+  len = std::min(len, ring->capacity() - prefixLen -
+                          (stamped ? StagingRing::kStampHeaderSize : 0));
+  const size_t total = prefixLen + len;
+  auto write = [&]() {
+    return stamped ? ring->writeStamped(stamp, prefix, prefixLen, logline, len)
+                   : ring->write(prefix, prefixLen, logline, len);
+  };
+  // 环形缓冲区超过 3/4 时视为空间紧张
+  const size_t highWater = ring->capacity() / 4 * 3;
+  if (ring->used() > highWater && ring->refreshUsed() > highWater &&
+      shed(level)) {
+    recordDrop(level, total);
+    return;
+  }
+  if (!write()) {
+    // 后端线程未运行时无人排空，只能丢弃
+    if (!running_ || !shouldBlock(level)) {
+      recordDrop(level, total);
+      return;
     }
+    // 唤醒后端线程，等它排空一轮后再重试
+    uint64_t start = nowNanos();
+    bool written;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!(written = write()) && running_) {
+        pending_ = true;
+        cond_.notify_one();
+        drainCond_.wait(lock);
+      }
+    }
+    counters_.bufferWaits.fetch_add(1, std::memory_order_relaxed);
+    counters_.bufferWaitNanos.fetch_add(nowNanos() - start,
+                                        std::memory_order_relaxed);
+    if (!written) {
+      recordDrop(level, total);
+      return;
+    }
+  }
+  if (ring->used() > ring->capacity() / 2 &&
+      !pending_.load(std::memory_order_relaxed) && !pending_.exchange(true)) {
+    cond_.notify_one();
+  }
+}
+
+void AsyncLogging::Impl::threadFuncLocal() {
+  LogFile output(basename_, rollSize_, fileOptions());
 
-    buffersToWrite.clear();
+  std::vector<std::shared_ptr<StagingRing>> rings;
+  uint64_t reportedDrops = 0;
+  uint64_t lastStatsReport = nowNanos();
+  // 二进制记录可能跨越环形缓冲区的首尾，先拼接成连续内存；返回排空的字节数
+  auto drain = [this, &output](StagingRing &ring) -> size_t {
+    if (format_ == RecordFormat::kText) {
+      return ring.drain([&output](const char *data, size_t len) {
+        output.append(data, len);
+      });
+    }
+    staging_.clear();
+    size_t drained = ring.drain([this](const char *data, size_t len) {
+      staging_.append(data, len);
+    });
+    this->output(output, staging_.data(), staging_.size());
+    return drained;
+  };
+
+  // 有记录留在重排窗口中时，窗口过后再来写出
+  bool held = false;
+  while (running_) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!pending_) {
+        if (held) {
+          cond_.wait_for(lock, std::chrono::milliseconds(reorderWindow_));
+        } else {
+          cond_.wait_for(lock, std::chrono::seconds(flushInterval_));
+        }
+      }
+      pending_ = false;
+      // 回收生产者线程已退出且已排空的环形缓冲区，其统计并入 retired*
+      rings_.erase(
+          std::remove_if(rings_.begin(), rings_.end(),
+                         [this](const std::shared_ptr<StagingRing> &r) {
+                           if (!r->closed() || !r->empty()) {
+                             return false;
+                           }
+                           addCounter(counters_.retiredMessages,
+                                      r->records());
+                           addCounter(counters_.retiredBytes,
+                                      r->bytesWritten());
+                           return true;
+                         }),
+          rings_.end());
+      rings = rings_;
+    }
+    reportDrops(output, &reportedDrops);
+    uint64_t writeStart = nowNanos();
+    uint64_t batchBytes = 0;
+    if (reorderWindow_ > 0) {
+      batchBytes = merge(output, rings, reorderCutoff(rings), &held);
+    } else {
+      // 每个环形缓冲区中都是完整的日志行，逐个排空即可
+      for (auto &ring : rings) {
+        batchBytes += drain(*ring);
+      }
+    }
+    // 唤醒因环形缓冲区已满而阻塞的生产者
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+    }
+    drainCond_.notify_all();
+    uint64_t flushStart = nowNanos();
     output.flush();
+    recordBatch(batchBytes, flushStart - writeStart, nowNanos() - flushStart);
+    reportStats(output, &lastStatsReport, false);
   }
+
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    rings = rings_;
+  }
+  if (reorderWindow_ > 0) {
+    merge(output, rings, INT64_MAX, &held);
+  } else {
+    for (auto &ring : rings) {
+      drain(*ring);
+    }
+  }
+  reportDrops(output, &reportedDrops);
+  reportStats(output, &lastStatsReport, true);
   output.flush();
 }
 
+int64_t AsyncLogging::Impl::reorderCutoff(
+    const std::vector<std::shared_ptr<StagingRing>> &rings) {
+  // 各活跃线程之后写入的记录都不会早于其最近一条记录，
+  // 不早于所有活跃线程最近一条记录的部分已可安全写出；
+  // 空闲线程的时间戳停滞不前，由时间窗口兜底。
+  // 尚未写出第一条记录的线程可能已经读取了时间，其第一条记录
+  // 可能早于其它线程的记录，此时只能以时间窗口为界
+  int64_t watermark = INT64_MAX;
+  for (auto &ring : rings) {
+    if (ring->closed()) {
+      continue;
+    }
+    int64_t last = ring->lastStamp();
+    if (last == 0) {
+      watermark = INT64_MIN;
+      break;
+    }
+    watermark = std::min(watermark, last);
+  }
+  int64_t cutoff = readLogClock() - int64_t{reorderWindow_} * 1000000;
+  takeRecordTime();
+  return watermark == INT64_MAX ? cutoff : std::max(cutoff, watermark);
+}
+
+size_t AsyncLogging::Impl::merge(
+    LogFile &file, const std::vector<std::shared_ptr<StagingRing>> &rings,
+    int64_t cutoff, bool *held) {
+  // 小顶堆: (下一条记录的时间戳, 环形缓冲区下标)，时间戳相同时按下标
+  using Entry = std::pair<int64_t, size_t>;
+  auto later = std::greater<Entry>();
+  mergeHeap_.clear();
+  for (size_t i = 0; i < rings.size(); ++i) {
+    int64_t stamp;
+    if (rings[i]->peekStamp(&stamp)) {
+      mergeHeap_.emplace_back(stamp, i);
+    }
+  }
+  std::make_heap(mergeHeap_.begin(), mergeHeap_.end(), later);
+
+  // 二进制记录交给 output() 统一解码，先拼接成连续内存
+  const bool text = format_ == RecordFormat::kText;
+  staging_.clear();
+  size_t bytes = 0;
+  while (!mergeHeap_.empty() && mergeHeap_.front().first <= cutoff) {
+    std::pop_heap(mergeHeap_.begin(), mergeHeap_.end(), later);
+    size_t i = mergeHeap_.back().second;
+    mergeHeap_.pop_back();
+    bytes += rings[i]->pop([&](const char *data, size_t len) {
+      if (text) {
+        file.append(data, len);
+      } else {
+        staging_.append(data, len);
+      }
+    });
+    int64_t stamp;
+    if (rings[i]->peekStamp(&stamp)) {
+      mergeHeap_.emplace_back(stamp, i);
+      std::push_heap(mergeHeap_.begin(), mergeHeap_.end(), later);
+    }
+  }
+  if (!text) {
+    output(file, staging_.data(), staging_.size());
+  }
+  *held = !mergeHeap_.empty();
+  return bytes;
+}
+
+void AsyncLogging::Impl::reportDrops(LogFile &file, uint64_t *reported) {
+  DropStats stats = dropStats();
+  uint64_t total = stats.totalMessages();
+  if (total == *reported) {
+    return;
+  }
+  char buf[512];
+  int n = snprintf(buf, sizeof buf,
+                   "Drop %llu log messages under overload, total dropped:",
+                   static_cast<unsigned long long>(total - *reported));
+  for (size_t i = 0; i < kNumLevels; ++i) {
+    n += snprintf(buf + n, sizeof buf - n, " %s%llu/%lluB", LogLevelName[i],
+                  static_cast<unsigned long long>(stats.messages[i]),
+                  static_cast<unsigned long long>(stats.bytes[i]));
+  }
+  n += snprintf(buf + n, sizeof buf - n, "\n");
+  *reported = total;
+  // 同时输出到终端和日志文件
+  fputs(buf, stderr);
+  outputText(file, buf, n);
+}
+
+void AsyncLogging::Impl::recordBatch(uint64_t bytes, uint64_t writeNanos,
+                                     uint64_t flushNanos) {
+  // 超时醒来而没有日志的轮次不计入
+  if (bytes == 0) {
+    return;
+  }
+  addCounter(counters_.batches, 1);
+  addCounter(counters_.batchBytes, bytes);
+  maxCounter(counters_.maxBatchBytes, bytes);
+  addCounter(counters_.writeNanos, writeNanos);
+  maxCounter(counters_.maxWriteNanos, writeNanos);
+  addCounter(counters_.flushes, 1);
+  addCounter(counters_.flushNanos, flushNanos);
+  maxCounter(counters_.maxFlushNanos, flushNanos);
+}
+
+AsyncLogging::Stats AsyncLogging::Impl::stats() {
+  Stats stats;
+  stats.appendedMessages =
+      counters_.appendedMessages.load(std::memory_order_relaxed);
+  stats.appendedBytes = counters_.appendedBytes.load(std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stats.appendedMessages +=
+        counters_.retiredMessages.load(std::memory_order_relaxed);
+    stats.appendedBytes +=
+        counters_.retiredBytes.load(std::memory_order_relaxed);
+    for (auto &ring : rings_) {
+      stats.appendedMessages += ring->records();
+      stats.appendedBytes += ring->bytesWritten();
+    }
+  }
+  if (frontEnd_ == FrontEnd::kThreadLocal && reorderWindow_ > 0) {
+    stats.appendedBytes -=
+        stats.appendedMessages * StagingRing::kStampHeaderSize;
+  }
+  stats.bufferSwaps = counters_.bufferSwaps.load(std::memory_order_relaxed);
+  stats.lockWaits = counters_.lockWaits.load(std::memory_order_relaxed);
+  stats.lockWaitNanos = counters_.lockWaitNanos.load(std::memory_order_relaxed);
+  stats.bufferWaits = counters_.bufferWaits.load(std::memory_order_relaxed);
+  stats.bufferWaitNanos =
+      counters_.bufferWaitNanos.load(std::memory_order_relaxed);
+  stats.batches = counters_.batches.load(std::memory_order_relaxed);
+  stats.batchBytes = counters_.batchBytes.load(std::memory_order_relaxed);
+  stats.maxBatchBytes = counters_.maxBatchBytes.load(std::memory_order_relaxed);
+  stats.writeNanos = counters_.writeNanos.load(std::memory_order_relaxed);
+  stats.maxWriteNanos = counters_.maxWriteNanos.load(std::memory_order_relaxed);
+  stats.flushes = counters_.flushes.load(std::memory_order_relaxed);
+  stats.flushNanos = counters_.flushNanos.load(std::memory_order_relaxed);
+  stats.maxFlushNanos = counters_.maxFlushNanos.load(std::memory_order_relaxed);
+  stats.drops = dropStats();
+  return stats;
+}
+
+void AsyncLogging::Impl::reportStats(LogFile &file, uint64_t *lastReport,
+                                     bool force) {
+  if (statsInterval_ <= 0) {
+    return;
+  }
+  uint64_t now = nowNanos();
+  if (!force &&
+      now - *lastReport < static_cast<uint64_t>(statsInterval_) * 1000000000) {
+    return;
+  }
+  *lastReport = now;
+
+  Stats s = stats();
+  auto average = [](uint64_t total, uint64_t count) {
+    return static_cast<unsigned long long>(count ? total / count : 0);
+  };
+  char buf[512];
+  int n = snprintf(
+      buf, sizeof buf,
+      "AsyncLogging stats: appended %llu msgs/%lluB, swaps %llu, "
+      "lock waits %llu/%lluus, buffer waits %llu/%lluus, "
+      "batches %llu avg %lluB max %lluB, write avg %lluus max %lluus, "
+      "flush avg %lluus max %lluus, dropped %llu\n",
+      static_cast<unsigned long long>(s.appendedMessages),
+      static_cast<unsigned long long>(s.appendedBytes),
+      static_cast<unsigned long long>(s.bufferSwaps),
+      static_cast<unsigned long long>(s.lockWaits),
+      static_cast<unsigned long long>(s.lockWaitNanos / 1000),
+      static_cast<unsigned long long>(s.bufferWaits),
+      static_cast<unsigned long long>(s.bufferWaitNanos / 1000),
+      static_cast<unsigned long long>(s.batches),
+      average(s.batchBytes, s.batches),
+      static_cast<unsigned long long>(s.maxBatchBytes),
+      average(s.writeNanos / 1000, s.batches),
+      static_cast<unsigned long long>(s.maxWriteNanos / 1000),
+      average(s.flushNanos / 1000, s.flushes),
+      static_cast<unsigned long long>(s.maxFlushNanos / 1000),
+      static_cast<unsigned long long>(s.drops.totalMessages()));
+  outputText(file, buf, std::min<int>(n, sizeof buf - 1));
+}
+
+LogFileOptions AsyncLogging::Impl::fileOptions() {
+  LogFileOptions options;
+  options.flushInterval = flushInterval_;
+  if (format_ == RecordFormat::kBinaryFile) {
+    options.header = [this]() { return siteTable(); };
+  }
+  options.backend = backend_;
+  options.directIO = directIO_;
+  options.rollPeriod = rollPeriod_;
+  options.compression = compression_;
+  options.maxFiles = maxFiles_;
+  options.maxTotalBytes = maxTotalBytes_;
+  options.streamCompression = streamCompression_;
+  // 只由后端线程访问，并在每轮写入后自行 flush
+  options.threadSafe = false;
+  return options;
+}
+
+void AsyncLogging::Impl::submit(LogFile &file, const Buffer *buffer) {
+  switch (format_) {
+  case RecordFormat::kText:
+    file.submit(buffer->data(), buffer->length());
+    break;
+  case RecordFormat::kBinary:
+    output(file, buffer->data(), buffer->length());
+    break;
+  case RecordFormat::kBinaryFile:
+    defineSites(file);
+    file.submit(buffer->data(), buffer->length());
+    break;
+  }
+}
+
+void AsyncLogging::Impl::output(LogFile &file, const char *data, size_t len) {
+  switch (format_) {
+  case RecordFormat::kText:
+    file.append(data, len);
+    break;
+  case RecordFormat::kBinary:
+    decoded_.clear();
+    decoder_.decode(data, len, &decoded_);
+    file.append(decoded_.data(), decoded_.size());
+    break;
+  case RecordFormat::kBinaryFile:
+    defineSites(file);
+    file.append(data, len);
+    break;
+  }
+}
+
+void AsyncLogging::Impl::outputText(LogFile &file, const char *text,
+                                    size_t len) {
+  if (format_ == RecordFormat::kBinaryFile) {
+    char header[binary::kRecordHeaderSize];
+    binary::encodeRecordHeader(header,
+                               static_cast<uint32_t>(sizeof header + len),
+                               binary::kTextSite);
+    file.append(header, sizeof header);
+  }
+  file.append(text, len);
+}
+
+void AsyncLogging::Impl::defineSites(LogFile &file) {
+  // 缓冲区中的记录所引用的调用点都已注册，补写新出现的调用点定义即可
+  uint32_t count = logSiteCount();
+  if (count <= definedSites_) {
+    return;
+  }
+  string defs;
+  for (uint32_t id = definedSites_ + 1; id <= count; ++id) {
+    binary::encodeSiteDefinition(id, *findLogSite(id), &defs);
+  }
+  definedSites_ = count;
+  file.append(defs.data(), defs.size());
+}
+
+string AsyncLogging::Impl::siteTable() {
+  // 每个新日志文件都以完整的调用点定义开头，可以独立解码
+  string defs;
+  uint32_t count = logSiteCount();
+  for (uint32_t id = 1; id <= count; ++id) {
+    binary::encodeSiteDefinition(id, *findLogSite(id), &defs);
+  }
+  definedSites_ = count;
+  return defs;
+}
+
 AsyncLogging::AsyncLogging(const string &basename, int rollSize,
                            int flushInterval)
     : impl_(std::make_unique<Impl>(basename, rollSize, flushInterval)) {}
 AsyncLogging::~AsyncLogging() {}
 
-void AsyncLogging::append(const char *logline, size_t len) {
-  impl_->append(logline, len);
+void AsyncLogging::setFrontEnd(FrontEnd frontEnd, size_t ringSize) {
+  impl_->setFrontEnd(frontEnd, ringSize);
+}
+
+void AsyncLogging::setRecordFormat(RecordFormat format) {
+  impl_->setRecordFormat(format);
+}
+
+void AsyncLogging::setWriteBackend(WriteBackend backend, bool directIO) {
+  impl_->setWriteBackend(backend, directIO);
+}
+
+void AsyncLogging::setStreamCompression(Compression compression) {
+  impl_->setStreamCompression(compression);
+}
+
+void AsyncLogging::setRolling(RollPeriod period, Compression compression,
+                              size_t maxFiles, uint64_t maxTotalBytes) {
+  impl_->setRolling(period, compression, maxFiles, maxTotalBytes);
+}
+
+void AsyncLogging::setBufferPool(size_t buffers, bool lockMemory,
+                                 bool hugePages) {
+  impl_->setBufferPool(buffers, lockMemory, hugePages);
+}
+
+void AsyncLogging::setOverloadPolicy(OverloadPolicy policy, LogLevel keepLevel,
+                                     uint32_t sampleRate) {
+  impl_->setOverloadPolicy(policy, keepLevel, sampleRate);
+}
+
+void AsyncLogging::append(const char *logline, size_t len, LogLevel level) {
+  impl_->append(logline, len, level);
+}
+
+void AsyncLogging::appendRecord(const char *record, size_t len,
+                                LogLevel level) {
+  impl_->appendRecord(record, len, level);
+}
+
+AsyncLogging::DropStats AsyncLogging::dropStats() const {
+  return impl_->dropStats();
+}
+
+AsyncLogging::Stats AsyncLogging::stats() const { return impl_->stats(); }
+
+void AsyncLogging::setStatsInterval(int seconds) {
+  impl_->setStatsInterval(seconds);
+}
+
+void AsyncLogging::setReorderWindow(int milliseconds) {
+  impl_->setReorderWindow(milliseconds);
+}
+
+uint64_t AsyncLogging::DropStats::totalMessages() const {
+  uint64_t total = 0;
+  for (uint64_t n : messages) {
+    total += n;
+  }
+  return total;
+}
+
+uint64_t AsyncLogging::DropStats::totalBytes() const {
+  uint64_t total = 0;
+  for (uint64_t n : bytes) {
+    total += n;
+  }
+  return total;
 }
 
 void AsyncLogging::start() { impl_->start(); }
@@ -0,0 +1,104 @@
+#include "background_worker.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace log {
+
+namespace {
+// linux/ioprio.h 未必随内核头文件安装，这里只用到 idle 类
+constexpr int kIoprioWhoProcess = 1;
+constexpr int kIoprioClassIdle = 3;
+constexpr int kIoprioClassShift = 13;
+
+// 尽量降低当前线程的 CPU 与 I/O 优先级，失败时忽略
+void lowerPriority() {
+  sched_param param = {};
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0) {
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+  }
+  syscall(SYS_ioprio_set, kIoprioWhoProcess, 0,
+          kIoprioClassIdle << kIoprioClassShift);
+}
+} // namespace
+
+class BackgroundWorker::Impl {
+public:
+  explicit Impl(bool idle) : idle_(idle), running_(false) {}
+  ~Impl();
+
+  void post(Task task);
+
+private:
+  void threadFunc();
+
+  const bool idle_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Task> tasks_;
+  bool running_;
+  std::thread thread_;
+};
+
+BackgroundWorker::Impl::~Impl() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    running_ = false;
+  }
+  cond_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void BackgroundWorker::Impl::post(Task task) {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    tasks_.push_back(std::move(task));
+    if (!thread_.joinable()) {
+      running_ = true;
+      thread_ = std::thread([this]() { threadFunc(); });
+    }
+  }
+  cond_.notify_one();
+}
+
+void BackgroundWorker::Impl::threadFunc() {
+  if (idle_) {
+    lowerPriority();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cond_.wait(lock, [this]() { return !running_ || !tasks_.empty(); });
+    if (tasks_.empty()) {
+      break;
+    }
+    Task task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+}
+
+SINGLETON_PATTERN_IMPLEMENT(BackgroundWorker)
+
+BackgroundWorker &BackgroundWorker::urgent() {
+  static BackgroundWorker instance(false);
+  return instance;
+}
+
+BackgroundWorker::BackgroundWorker() : BackgroundWorker(true) {}
+BackgroundWorker::BackgroundWorker(bool idle)
+    : impl_(std::make_unique<Impl>(idle)) {}
+BackgroundWorker::~BackgroundWorker() {}
+
+void BackgroundWorker::post(Task task) { impl_->post(std::move(task)); }
+
+} // namespace log
@@ -0,0 +1,261 @@
+#include "binary_decoder.h"
+#include "binary_logging.h"
+#include "line_pattern.h"
+#include <cstdio>
+#include <vector>
+
+namespace log {
+
+class BinaryDecoder::Impl {
+public:
+  explicit Impl(bool useRegistry) : useRegistry_(useRegistry), lastTid_(0) {}
+
+  size_t decode(const char *data, size_t len, string *out);
+
+private:
+  struct Site {
+    bool valid = false;
+    string file;
+    string format;
+    int line = 0;
+    LogLevel level = LogLevel::INFO;
+  };
+
+  const Site *findSite(uint32_t id);
+  void defineSite(const char *payload, size_t len);
+  void decodeEvent(uint32_t id, const char *payload, size_t len, string *out);
+  size_t formatArg(const char *p, const char *end);
+
+  template <typename T> static T load(const char *p) {
+    T v;
+    memcpy(&v, p, sizeof v);
+    return v;
+  }
+
+private:
+  const bool useRegistry_;
+  std::vector<Site> sites_; // sites_[id - 1]
+  LogStream stream_;
+  int32_t lastTid_;
+  char tidString_[32];
+  int tidLength_;
+};
+
+size_t BinaryDecoder::Impl::decode(const char *data, size_t len,
+                                   string *out) {
+  size_t pos = 0;
+  while (len - pos >= binary::kRecordHeaderSize) {
+    uint32_t size = load<uint32_t>(data + pos);
+    uint32_t siteId = load<uint32_t>(data + pos + 4);
+    if (size < binary::kRecordHeaderSize) {
+      // 记录头已损坏，无法再定位后续记录
+      out->append("<corrupted binary log record>\n");
+      return len;
+    }
+    if (len - pos < size) {
+      break;
+    }
+    const char *payload = data + pos + binary::kRecordHeaderSize;
+    size_t payloadLen = size - binary::kRecordHeaderSize;
+    if (siteId == binary::kTextSite) {
+      out->append(payload, payloadLen);
+    } else if (siteId == binary::kSiteDefinition) {
+      defineSite(payload, payloadLen);
+    } else {
+      decodeEvent(siteId, payload, payloadLen, out);
+    }
+    pos += size;
+  }
+  return pos;
+}
+
+const BinaryDecoder::Impl::Site *BinaryDecoder::Impl::findSite(uint32_t id) {
+  if (id <= sites_.size() && sites_[id - 1].valid) {
+    return &sites_[id - 1];
+  }
+  if (!useRegistry_) {
+    return nullptr;
+  }
+  const LogSite *site = findLogSite(id);
+  if (site == nullptr) {
+    return nullptr;
+  }
+  if (sites_.size() < id) {
+    sites_.resize(id);
+  }
+  Site &cached = sites_[id - 1];
+  cached.valid = true;
+  cached.file.assign(site->file.data(), site->file.size());
+  cached.format = site->format;
+  cached.line = site->line;
+  cached.level = site->level;
+  return &cached;
+}
+
+void BinaryDecoder::Impl::defineSite(const char *payload, size_t len) {
+  const char *p = payload;
+  const char *end = payload + len;
+  constexpr size_t kFixed = sizeof(uint32_t) + sizeof(int32_t) + 1;
+  if (static_cast<size_t>(end - p) < kFixed + sizeof(uint16_t)) {
+    return;
+  }
+  uint32_t id = load<uint32_t>(p);
+  int32_t line = load<int32_t>(p + 4);
+  uint8_t level = static_cast<uint8_t>(p[8]);
+  p += kFixed;
+  uint16_t fileLen = load<uint16_t>(p);
+  p += sizeof fileLen;
+  if (id == 0 || id == binary::kSiteDefinition ||
+      level >= static_cast<uint8_t>(LogLevel::NUM_LOG_LEVELS) ||
+      static_cast<size_t>(end - p) < fileLen + sizeof(uint16_t)) {
+    return;
+  }
+  const char *file = p;
+  p += fileLen;
+  uint16_t formatLen = load<uint16_t>(p);
+  p += sizeof formatLen;
+  if (static_cast<size_t>(end - p) < formatLen) {
+    return;
+  }
+
+  if (sites_.size() < id) {
+    sites_.resize(id);
+  }
+  Site &site = sites_[id - 1];
+  site.valid = true;
+  site.file.assign(file, fileLen);
+  site.format.assign(p, formatLen);
+  site.line = line;
+  site.level = static_cast<LogLevel>(level);
+}
+
+void BinaryDecoder::Impl::decodeEvent(uint32_t id, const char *payload,
+                                      size_t len, string *out) {
+  if (len < binary::kEventHeaderSize - binary::kRecordHeaderSize) {
+    return;
+  }
+  int64_t timestamp = load<int64_t>(payload);
+  int32_t tid = load<int32_t>(payload + sizeof timestamp);
+  const char *p = payload + sizeof timestamp + sizeof tid;
+  const char *end = payload + len;
+
+  stream_.resetBuffer();
+  if (tid != lastTid_) {
+    tidLength_ = snprintf(tidString_, sizeof tidString_, "%5d", tid);
+    lastTid_ = tid;
+    LinePattern::invalidateThreadCache();
+  }
+
+  const Site *site = findSite(id);
+  if (site == nullptr) {
+    char timebuf[64];
+    int n = formatLogTime(timebuf, static_cast<time_t>(timestamp / 1000000),
+                          static_cast<int>(timestamp % 1000000));
+    stream_.append(timebuf, n);
+    stream_ << StringPiece(tidString_, tidLength_) << " <unknown log site "
+            << id << ">\n";
+    out->append(stream_.buffer().data(), stream_.buffer().length());
+    return;
+  }
+  // 与 Logger 使用同一个行布局
+  const LinePattern &pattern = Logger::pattern();
+  LinePattern::Context context{static_cast<time_t>(timestamp / 1000000),
+                               static_cast<int>(timestamp % 1000000),
+                               tidString_,
+                               tidLength_,
+                               site->level,
+                               site->file.c_str(),
+                               static_cast<int>(site->file.size()),
+                               site->line};
+  pattern.formatPrefix(stream_, context);
+
+  // 与 binary::formatTo 相同: 依次替换 "{}"，多余的参数以空格分隔追加
+  const char *format = site->format.c_str();
+  while (p < end) {
+    const char *placeholder = strstr(format, "{}");
+    if (placeholder) {
+      stream_.append(format, static_cast<int>(placeholder - format));
+      format = placeholder + 2;
+    } else {
+      stream_ << format << ' ';
+      format = "";
+    }
+    size_t consumed = formatArg(p, end);
+    if (consumed == 0) {
+      break;
+    }
+    p += consumed;
+  }
+  stream_ << format;
+  pattern.formatSuffix(stream_, context);
+  out->append(stream_.buffer().data(), stream_.buffer().length());
+}
+
+size_t BinaryDecoder::Impl::formatArg(const char *p, const char *end) {
+  size_t avail = end - p;
+  if (avail < 1) {
+    return 0;
+  }
+  const char *value = p + 1;
+  switch (static_cast<binary::ArgType>(*p)) {
+  case binary::ArgType::kInt64:
+    if (avail < 1 + sizeof(int64_t)) {
+      return 0;
+    }
+    stream_ << static_cast<long long>(load<int64_t>(value));
+    return 1 + sizeof(int64_t);
+  case binary::ArgType::kUInt64:
+    if (avail < 1 + sizeof(uint64_t)) {
+      return 0;
+    }
+    stream_ << static_cast<unsigned long long>(load<uint64_t>(value));
+    return 1 + sizeof(uint64_t);
+  case binary::ArgType::kDouble:
+    if (avail < 1 + sizeof(double)) {
+      return 0;
+    }
+    stream_ << load<double>(value);
+    return 1 + sizeof(double);
+  case binary::ArgType::kPointer:
+    if (avail < 1 + sizeof(uint64_t)) {
+      return 0;
+    }
+    stream_ << reinterpret_cast<const void *>(
+        static_cast<uintptr_t>(load<uint64_t>(value)));
+    return 1 + sizeof(uint64_t);
+  case binary::ArgType::kChar:
+    if (avail < 2) {
+      return 0;
+    }
+    stream_ << *value;
+    return 2;
+  case binary::ArgType::kBool:
+    if (avail < 2) {
+      return 0;
+    }
+    stream_ << (*value != 0);
+    return 2;
+  case binary::ArgType::kString: {
+    if (avail < 1 + sizeof(uint32_t)) {
+      return 0;
+    }
+    uint32_t n = load<uint32_t>(value);
+    if (avail < 1 + sizeof(uint32_t) + n) {
+      return 0;
+    }
+    stream_ << StringPiece(value + sizeof(uint32_t), static_cast<int>(n));
+    return 1 + sizeof(uint32_t) + n;
+  }
+  }
+  return 0;
+}
+
+BinaryDecoder::BinaryDecoder(bool useRegistry)
+    : impl_(std::make_unique<Impl>(useRegistry)) {}
+BinaryDecoder::~BinaryDecoder() {}
+
+size_t BinaryDecoder::decode(const char *data, size_t len, string *out) {
+  return impl_->decode(data, len, out);
+}
+
+} // namespace log
@@ -0,0 +1,95 @@
+#include "binary_logging.h"
+#include "current_thread.h"
+#include <algorithm>
+#include <mutex>
+#include <time.h>
+#include <vector>
+
+namespace log {
+
+namespace {
+std::mutex g_sitesMutex;
+std::vector<const LogSite *> g_sites; // g_sites[id - 1]
+LevelOutputFunc g_binaryOutput;
+} // namespace
+
+uint32_t registerLogSite(LogSite *site) {
+  std::lock_guard<std::mutex> guard(g_sitesMutex);
+  uint32_t id = site->id.load(std::memory_order_relaxed);
+  if (id == 0) {
+    g_sites.push_back(site);
+    id = static_cast<uint32_t>(g_sites.size());
+    site->id.store(id, std::memory_order_release);
+  }
+  return id;
+}
+
+uint32_t logSiteCount() {
+  std::lock_guard<std::mutex> guard(g_sitesMutex);
+  return static_cast<uint32_t>(g_sites.size());
+}
+
+const LogSite *findLogSite(uint32_t id) {
+  std::lock_guard<std::mutex> guard(g_sitesMutex);
+  if (id == 0 || id > g_sites.size()) {
+    return nullptr;
+  }
+  return g_sites[id - 1];
+}
+
+void setBinaryOutput(LevelOutputFunc out) { g_binaryOutput = out; }
+
+bool hasBinaryOutput() { return static_cast<bool>(g_binaryOutput); }
+
+void binaryOutput(const char *record, int len, LogLevel level) {
+  g_binaryOutput(record, len, level);
+}
+
+namespace binary {
+
+void encodeSiteDefinition(uint32_t id, const LogSite &site, string *out) {
+  uint16_t fileLen =
+      static_cast<uint16_t>(std::min<int>(site.file.size(), UINT16_MAX));
+  uint16_t formatLen = static_cast<uint16_t>(strnlen(site.format, UINT16_MAX));
+  int32_t line = site.line;
+  uint8_t level = static_cast<uint8_t>(site.level);
+  uint32_t size = kRecordHeaderSize + sizeof id + sizeof line + sizeof level +
+                  sizeof fileLen + fileLen + sizeof formatLen + formatLen;
+
+  char header[kRecordHeaderSize];
+  encodeRecordHeader(header, size, kSiteDefinition);
+  out->append(header, sizeof header);
+  out->append(reinterpret_cast<const char *>(&id), sizeof id);
+  out->append(reinterpret_cast<const char *>(&line), sizeof line);
+  out->append(reinterpret_cast<const char *>(&level), sizeof level);
+  out->append(reinterpret_cast<const char *>(&fileLen), sizeof fileLen);
+  out->append(site.file.data(), fileLen);
+  out->append(reinterpret_cast<const char *>(&formatLen), sizeof formatLen);
+  out->append(site.format, formatLen);
+}
+
+RecordEncoder::RecordEncoder(uint32_t siteId)
+    : siteId_(siteId), len_(kEventHeaderSize) {
+  int64_t timestamp = readLogClock() / 1000;
+  int32_t tid = currentthread::tid();
+  memcpy(buf_ + kRecordHeaderSize, &timestamp, sizeof timestamp);
+  memcpy(buf_ + kRecordHeaderSize + sizeof timestamp, &tid, sizeof tid);
+}
+
+void RecordEncoder::addString(const char *str, size_t len) {
+  constexpr size_t kOverhead = 1 + sizeof(uint32_t);
+  if (len_ + kOverhead > sizeof buf_) {
+    return;
+  }
+  // 字符串过长时截断到剩余空间
+  uint32_t n = static_cast<uint32_t>(
+      std::min(len, sizeof buf_ - len_ - kOverhead));
+  buf_[len_] = static_cast<char>(ArgType::kString);
+  memcpy(buf_ + len_ + 1, &n, sizeof n);
+  memcpy(buf_ + len_ + kOverhead, str, n);
+  len_ += kOverhead + n;
+}
+
+} // namespace binary
+
+} // namespace log
@@ -0,0 +1,156 @@
+#include "escape.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace log {
+
+namespace {
+const char digitsHex[] = "0123456789abcdef";
+
+inline bool isJsonSpecial(unsigned char c) {
+  return c == '"' || c == '\\' || c < 0x20;
+}
+
+inline bool isLogfmtSpecial(unsigned char c) {
+  return c == '"' || c == '\\' || c == '=' || c <= 0x20;
+}
+
+#if defined(__SSE2__)
+// 每字节 <= limit 时对应位置为 0xFF（无符号比较）
+inline __m128i lessEqual(__m128i chunk, __m128i limit) {
+  return _mm_cmpeq_epi8(_mm_max_epu8(chunk, limit), limit);
+}
+#endif
+} // namespace
+
+size_t findJsonEscape(const char *src, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i mask = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                             _mm_cmpeq_epi8(chunk, backslash)),
+                                lessEqual(chunk, control));
+    int bits = _mm_movemask_epi8(mask);
+    if (bits != 0) {
+      return i + __builtin_ctz(bits);
+    }
+  }
+#endif
+  for (; i < len; ++i) {
+    if (isJsonSpecial(static_cast<unsigned char>(src[i]))) {
+      return i;
+    }
+  }
+  return len;
+}
+
+size_t utf8Boundary(const char *src, size_t pos) {
+  // 后续字节为 10xxxxxx；非法的输入最多退回 3 字节
+  for (int i = 0; i < 3 && pos > 0 &&
+                  (static_cast<unsigned char>(src[pos]) & 0xC0) == 0x80;
+       ++i) {
+    --pos;
+  }
+  return pos;
+}
+
+size_t escapeJson(const char *src, size_t len, char *dst, size_t cap,
+                  size_t *consumed) {
+  const char *start = src;
+  size_t out = 0;
+  size_t done = 0; // 已转义的源字节数
+  for (;;) {
+    // 整段复制不需要转义的部分
+    size_t n = findJsonEscape(src, len);
+    if (n > cap - out) {
+      size_t k = utf8Boundary(src, cap - out);
+      memcpy(dst + out, src, k);
+      done = src - start + k;
+      out += k;
+      break;
+    }
+    memcpy(dst + out, src, n);
+    out += n;
+    if (n == len) {
+      done = src - start + n;
+      break;
+    }
+
+    unsigned char c = static_cast<unsigned char>(src[n]);
+    char escaped[6] = {'\\', 0, 0, 0, 0, 0};
+    size_t escapedLen = 2;
+    switch (c) {
+    case '"':
+    case '\\':
+      escaped[1] = static_cast<char>(c);
+      break;
+    case '\n':
+      escaped[1] = 'n';
+      break;
+    case '\r':
+      escaped[1] = 'r';
+      break;
+    case '\t':
+      escaped[1] = 't';
+      break;
+    default:
+      memcpy(escaped + 1, "u00", 3);
+      escaped[4] = digitsHex[c >> 4];
+      escaped[5] = digitsHex[c & 0xF];
+      escapedLen = 6;
+      break;
+    }
+    if (escapedLen > cap - out) {
+      done = src - start + n;
+      break;
+    }
+    memcpy(dst + out, escaped, escapedLen);
+    out += escapedLen;
+    src += n + 1;
+    len -= n + 1;
+  }
+  if (consumed != nullptr) {
+    *consumed = done;
+  }
+  return out;
+}
+
+bool logfmtNeedsQuote(const char *src, size_t len) {
+  if (len == 0) {
+    return true;
+  }
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i equal = _mm_set1_epi8('=');
+  const __m128i space = _mm_set1_epi8(0x20);
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i mask = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, equal), lessEqual(chunk, space)));
+    if (_mm_movemask_epi8(mask) != 0) {
+      return true;
+    }
+  }
+#endif
+  for (; i < len; ++i) {
+    if (isLogfmtSpecial(static_cast<unsigned char>(src[i]))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace log
@@ -0,0 +1,361 @@
+#include "line_pattern.h"
+#include "logger.h"
+#include <atomic>
+#include <cstdio>
+
+namespace log {
+
+namespace {
+// 当前线程缓存的 "YYYY-MM-DD HH:MM:SS"，同一秒内只格式化一次
+thread_local time_t t_lastSecond = -1;
+thread_local char t_dateTime[64];
+
+inline const char *dateTime(time_t seconds) {
+  if (seconds != t_lastSecond) {
+    struct tm timeInfo;
+    gmtime_r(&seconds, &timeInfo);
+    snprintf(t_dateTime, sizeof t_dateTime, "%4d-%02d-%02d %02d:%02d:%02d",
+             timeInfo.tm_year + 1900, timeInfo.tm_mon + 1, timeInfo.tm_mday,
+             timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec);
+    t_lastSecond = seconds;
+  }
+  return t_dateTime;
+}
+std::atomic<uint64_t> g_patternVersion(0);
+
+// 当前线程缓存的行首，见 LinePattern::runCachedPrefix()
+constexpr size_t kMaxCachedPrefix = 128;
+constexpr size_t kMaxPatches = 8;
+
+struct PrefixCache {
+  struct Patch {
+    uint8_t code;
+    uint8_t offset;
+  };
+
+  uint64_t version = 0;
+  time_t second = -1;
+  const char *tid = nullptr;
+  int tidLength = -1;
+  size_t length = 0;
+  Patch patches[kMaxPatches];
+  size_t numPatches = 0;
+  // 字面量按定长拷贝，多留出余量
+  char text[kMaxCachedPrefix + 32];
+};
+
+thread_local PrefixCache t_prefixCache;
+
+// 借助两位数字表从右向左写入临时缓冲区，再以定长拷贝代替 memcpy 调用，
+// 调用方需保证 p 之后至少有 16 字节空间；返回写入之后的位置
+inline char *formatLine(char *p, int line) {
+  if (line < 0) {
+    return p + snprintf(p, 12, "%d", line);
+  }
+  char digits[32];
+  char *end = digits + 16;
+  char *q = end;
+  unsigned value = static_cast<unsigned>(line);
+  while (value >= 100) {
+    q -= 2;
+    memcpy(q, kDigitPairs + value % 100 * 2, 2);
+    value /= 100;
+  }
+  if (value >= 10) {
+    q -= 2;
+    memcpy(q, kDigitPairs + value * 2, 2);
+  } else {
+    *--q = static_cast<char>('0' + value);
+  }
+  memcpy(p, q, 16);
+  return p + (end - q);
+}
+} // namespace
+
+LinePattern::LinePattern()
+    : needsTime_(false), cachePrefix_(false), version_(0) {
+  compile(kDefaultPattern);
+}
+
+bool LinePattern::compile(const char *pattern) {
+  std::vector<Op> ops;
+  string literals;
+  size_t messageIndex = SIZE_MAX;
+  bool needsTime = false;
+
+  auto addLiteral = [&](const char *data, size_t len) {
+    // 相邻的字面量合并为一次拷贝
+    if (!ops.empty() && ops.back().code == OpCode::kLiteral &&
+        ops.size() != messageIndex) {
+      ops.back().length += static_cast<uint32_t>(len);
+    } else {
+      ops.push_back(Op{OpCode::kLiteral,
+                       static_cast<uint32_t>(literals.size()),
+                       static_cast<uint32_t>(len)});
+    }
+    literals.append(data, len);
+  };
+
+  for (const char *p = pattern; *p != '\0'; ++p) {
+    if (*p != '%') {
+      addLiteral(p, 1);
+      continue;
+    }
+    OpCode code;
+    switch (*++p) {
+    case '%':
+      addLiteral(p, 1);
+      continue;
+    case 'm':
+      if (messageIndex != SIZE_MAX) {
+        fprintf(stderr, "LinePattern: duplicate %%m in \"%s\"\n", pattern);
+        return false;
+      }
+      messageIndex = ops.size();
+      continue;
+    case 'D':
+      code = OpCode::kDate;
+      break;
+    case 'T':
+      code = OpCode::kTime;
+      break;
+    case 'u':
+      code = OpCode::kMicros;
+      break;
+    case 'e':
+      code = OpCode::kMillis;
+      break;
+    case 't':
+      code = OpCode::kTid;
+      break;
+    case 'l':
+      code = OpCode::kLevel;
+      break;
+    case 'f':
+      code = OpCode::kFile;
+      break;
+    case 'n':
+      code = OpCode::kLine;
+      break;
+    default:
+      fprintf(stderr, "LinePattern: unknown directive '%%%c' in \"%s\"\n",
+              *p == '\0' ? ' ' : *p, pattern);
+      return false;
+    }
+    needsTime = needsTime || code == OpCode::kDate || code == OpCode::kTime ||
+                code == OpCode::kMicros || code == OpCode::kMillis;
+
+    // 中间没有 %m 的 "%D %T" 合并为一次拷贝
+    size_t n = ops.size();
+    if (code == OpCode::kTime && n >= 2 && messageIndex != n - 1 &&
+        messageIndex != n && ops[n - 2].code == OpCode::kDate &&
+        ops[n - 1].code == OpCode::kLiteral && ops[n - 1].length == 1 &&
+        literals[ops[n - 1].offset] == ' ') {
+      literals.resize(ops[n - 1].offset);
+      ops.pop_back();
+      ops.back().code = OpCode::kDateTime;
+      continue;
+    }
+    ops.push_back(Op{code, 0, 0});
+  }
+
+  // 短字面量按固定长度拷贝，末尾补齐，保证读取不越界
+  literals.append(kLiteralPadding, '\0');
+  ops_.swap(ops);
+  literals_.swap(literals);
+  if (messageIndex == SIZE_MAX) {
+    messageIndex = ops_.size();
+  }
+  prefix_ = makeRange(0, messageIndex, false);
+  suffix_ = makeRange(messageIndex, ops_.size(), true);
+  needsTime_ = needsTime;
+
+  size_t variableFields = 0;
+  for (size_t i = prefix_.begin; i < prefix_.end; ++i) {
+    OpCode code = ops_[i].code;
+    if (code == OpCode::kMicros || code == OpCode::kMillis ||
+        code == OpCode::kLevel) {
+      ++variableFields;
+    } else if (code == OpCode::kLine) {
+      variableFields = kMaxPatches + 1;
+    }
+  }
+  cachePrefix_ = !prefix_.hasFile && variableFields <= kMaxPatches &&
+                 prefix_.maxLength <= kMaxCachedPrefix;
+  version_ = g_patternVersion.fetch_add(1, std::memory_order_relaxed) + 1;
+  return true;
+}
+
+LinePattern::Range LinePattern::makeRange(size_t begin, size_t end,
+                                          bool newline) const {
+  Range range{begin, end, newline ? 1u : 0u, false, newline};
+  for (size_t i = begin; i < end; ++i) {
+    switch (ops_[i].code) {
+    case OpCode::kLiteral:
+      range.maxLength += ops_[i].length;
+      break;
+    case OpCode::kDateTime:
+      range.maxLength += 19;
+      break;
+    case OpCode::kFile:
+      range.hasFile = true;
+      break;
+    default:
+      // 日期、时间、微秒、毫秒、级别、行号都不超过 11 字节，线程 id 不超过 31
+      range.maxLength += 32;
+      break;
+    }
+  }
+  return range;
+}
+
+void LinePattern::run(LogStream &stream, const Context &context,
+                      const Range &range) const {
+  size_t fileLength = range.hasFile ? context.fileLength : 0;
+  size_t maxLength = range.maxLength + fileLength + kLiteralPadding;
+  if (range.newline) {
+    // 行尾不受正文长度上限限制
+    stream.finishMessage(maxLength);
+  }
+  char *out = stream.reserve(maxLength);
+  if (out != nullptr) {
+    stream.commit(write(out, context, range, fileLength) - out);
+  } else {
+    runSlow(stream, context, range, fileLength, maxLength);
+  }
+}
+
+void LinePattern::runCachedPrefix(LogStream &stream,
+                                  const Context &context) const {
+  PrefixCache &cache = t_prefixCache;
+  if (cache.version != version_ || cache.second != context.seconds ||
+      cache.tid != context.tid || cache.tidLength != context.tidLength) {
+    // 重新生成行首，并记录逐行变化的字段的位置
+    cache.numPatches = 0;
+    char *p = cache.text;
+    for (size_t i = prefix_.begin; i < prefix_.end; ++i) {
+      OpCode code = ops_[i].code;
+      if (code == OpCode::kMicros || code == OpCode::kMillis ||
+          code == OpCode::kLevel) {
+        cache.patches[cache.numPatches++] = PrefixCache::Patch{
+            static_cast<uint8_t>(code), static_cast<uint8_t>(p - cache.text)};
+      }
+      p = write(p, context, Range{i, i + 1, 0, false, false}, 0);
+    }
+    cache.length = p - cache.text;
+    cache.version = version_;
+    cache.second = context.seconds;
+    cache.tid = context.tid;
+    cache.tidLength = context.tidLength;
+  }
+
+  char *out = stream.reserve(kMaxCachedPrefix);
+  if (out == nullptr) {
+    run(stream, context, prefix_);
+    return;
+  }
+  // 常见的行首不超过 64 字节
+  if (cache.length <= 64) {
+    memcpy(out, cache.text, 64);
+  } else {
+    memcpy(out, cache.text, kMaxCachedPrefix);
+  }
+  for (size_t i = 0; i < cache.numPatches; ++i) {
+    char *p = out + cache.patches[i].offset;
+    switch (static_cast<OpCode>(cache.patches[i].code)) {
+    case OpCode::kMicros:
+      memcpy(p, kDigitPairs + context.microseconds / 10000 * 2, 2);
+      memcpy(p + 2, kDigitPairs + context.microseconds / 100 % 100 * 2, 2);
+      memcpy(p + 4, kDigitPairs + context.microseconds % 100 * 2, 2);
+      break;
+    case OpCode::kMillis: {
+      int millis = context.microseconds / 1000;
+      *p = static_cast<char>('0' + millis / 100);
+      memcpy(p + 1, kDigitPairs + millis % 100 * 2, 2);
+      break;
+    }
+    default:
+      memcpy(p, LogLevelName[static_cast<uint32_t>(context.level)], 5);
+      break;
+    }
+  }
+  stream.commit(cache.length);
+}
+
+void LinePattern::invalidateThreadCache() { t_prefixCache.version = 0; }
+
+void LinePattern::runSlow(LogStream &stream, const Context &context,
+                          const Range &range, size_t fileLength,
+                          size_t maxLength) const {
+  // 空间不足时先写入临时缓冲区，由 append() 按原有的规则丢弃
+  char temp[kSmallBuffer];
+  if (maxLength <= sizeof temp) {
+    char *end = write(temp, context, range, fileLength);
+    stream.append(temp, static_cast<int>(end - temp));
+  }
+}
+
+char *LinePattern::write(char *p, const Context &context, const Range &range,
+                         size_t fileLength) const {
+  for (size_t i = range.begin; i < range.end; ++i) {
+    const Op &op = ops_[i];
+    switch (op.code) {
+    case OpCode::kLiteral:
+      // 字面量通常只有几个字节，按固定长度拷贝，避免调用 memcpy
+      if (op.length <= kLiteralPadding) {
+        memcpy(p, literals_.data() + op.offset, kLiteralPadding);
+      } else {
+        memcpy(p, literals_.data() + op.offset, op.length);
+      }
+      p += op.length;
+      break;
+    case OpCode::kDate:
+      memcpy(p, dateTime(context.seconds), 10);
+      p += 10;
+      break;
+    case OpCode::kTime:
+      memcpy(p, dateTime(context.seconds) + 11, 8);
+      p += 8;
+      break;
+    case OpCode::kDateTime:
+      memcpy(p, dateTime(context.seconds), 19);
+      p += 19;
+      break;
+    case OpCode::kMicros:
+      memcpy(p, kDigitPairs + context.microseconds / 10000 * 2, 2);
+      memcpy(p + 2, kDigitPairs + context.microseconds / 100 % 100 * 2, 2);
+      memcpy(p + 4, kDigitPairs + context.microseconds % 100 * 2, 2);
+      p += 6;
+      break;
+    case OpCode::kMillis: {
+      int millis = context.microseconds / 1000;
+      *p = static_cast<char>('0' + millis / 100);
+      memcpy(p + 1, kDigitPairs + millis % 100 * 2, 2);
+      p += 3;
+      break;
+    }
+    case OpCode::kTid:
+      memcpy(p, context.tid, context.tidLength);
+      p += context.tidLength;
+      break;
+    case OpCode::kLevel:
+      // LogLevelName 均为 6 字节，末尾为空格
+      memcpy(p, LogLevelName[static_cast<uint32_t>(context.level)], 5);
+      p += 5;
+      break;
+    case OpCode::kFile:
+      memcpy(p, context.file, fileLength);
+      p += fileLength;
+      break;
+    case OpCode::kLine:
+      p = formatLine(p, context.line);
+      break;
+    }
+  }
+  if (range.newline) {
+    *p++ = '\n';
+  }
+  return p;
+}
+
+} // namespace log
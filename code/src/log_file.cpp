@@ -1,91 +1,383 @@
 #include "log_file.h"
 #include "append_file.h"
+#include "background_worker.h"
 #include "mutex_macro.h"
+#include "stream_compressor.h"
+#include "timer_service.h"
+#include <algorithm>
 #include <atomic>
-#include <chrono>
+#include <dirent.h>
 #include <iostream>
 #include <mutex>
 #include <string>
+#include <sys/stat.h>
 #include <sys/time.h>
-#include <thread>
 #include <time.h>
 #include <unistd.h>
+#include <vector>
+#include <zlib.h>
 
-using std::atomic;
 using std::mutex;
 using std::string;
-using std::thread;
 using std::unique_ptr;
 
 namespace log {
 
 string getHostName();
 
+namespace {
+std::atomic<int> g_nextFileId(1);
+
+// 压缩为 path.gz 后删除原文件，失败时保留原文件
+void gzipFile(const string &path) {
+  FILE *in = fopen(path.c_str(), "rbe");
+  if (in == nullptr) {
+    return;
+  }
+  string tmp = path + ".gz.tmp";
+  gzFile out = gzopen(tmp.c_str(), "wbe");
+  if (out == nullptr) {
+    fclose(in);
+    fprintf(stderr, "LogFile: gzopen %s failed\n", tmp.c_str());
+    return;
+  }
+  bool ok = true;
+  char buf[64 * 1024];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof buf, in)) > 0) {
+    if (gzwrite(out, buf, static_cast<unsigned>(n)) != static_cast<int>(n)) {
+      ok = false;
+      break;
+    }
+  }
+  ok = ok && !ferror(in);
+  fclose(in);
+  ok = gzclose(out) == Z_OK && ok;
+  if (ok && rename(tmp.c_str(), (path + ".gz").c_str()) == 0) {
+    unlink(path.c_str());
+  } else {
+    fprintf(stderr, "LogFile: compress %s failed\n", path.c_str());
+    unlink(tmp.c_str());
+  }
+}
+
+/**
+ * 删除 basename 的已回滚文件中最旧的部分，直至满足个数与字节数限制
+ * 文件名中的时间戳紧跟 basename，按名字排序即按时间排序；
+ * 只考虑名字排在 newest 之前的文件，当前正在写入的文件不会被删除
+ */
+void removeExpired(const string &basename, const string &newest,
+                   size_t maxFiles, uint64_t maxTotalBytes) {
+  size_t slash = basename.rfind('/');
+  string dir = slash == string::npos ? "." : basename.substr(0, slash + 1);
+  string prefix =
+      (slash == string::npos ? basename : basename.substr(slash + 1)) + ".";
+  string newestName = newest.substr(slash == string::npos ? 0 : slash + 1);
+
+  struct Rolled {
+    string name;
+    uint64_t size;
+  };
+  std::vector<Rolled> files;
+  DIR *d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  while (dirent *entry = readdir(d)) {
+    string name = entry->d_name;
+    auto endsWith = [&name](const char *suffix, size_t len) {
+      return name.size() > len &&
+             name.compare(name.size() - len, len, suffix) == 0;
+    };
+    bool isLog = endsWith(".log", 4);
+    bool isGzip = endsWith(".log.gz", 7);
+    if (name.compare(0, prefix.size(), prefix) != 0 || !(isLog || isGzip) ||
+        name >= newestName) {
+      continue;
+    }
+    struct stat st;
+    if (stat((dir + "/" + name).c_str(), &st) == 0) {
+      files.push_back({name, static_cast<uint64_t>(st.st_size)});
+    }
+  }
+  closedir(d);
+
+  std::sort(files.begin(), files.end(),
+            [](const Rolled &a, const Rolled &b) { return a.name < b.name; });
+  uint64_t total = 0;
+  for (const Rolled &file : files) {
+    total += file.size;
+  }
+  size_t count = files.size();
+  for (const Rolled &file : files) {
+    if ((maxFiles == 0 || count <= maxFiles) &&
+        (maxTotalBytes == 0 || total <= maxTotalBytes)) {
+      break;
+    }
+    unlink((dir + "/" + file.name).c_str());
+    --count;
+    total -= file.size;
+  }
+}
+} // namespace
+
 class LogFile::Impl {
 public:
-  Impl(const string &basename, int rollSize, int flushInterval);
+  Impl(const string &basename, int rollSize, const LogFileOptions &options);
   ~Impl();
 
   void append(const char *logline, size_t len);
+  void submit(const char *data, size_t len);
+  void wait();
+  bool pending();
   void flush();
   void rollFile();
 
 private:
-  string getLogFileName(const string &basename);
-  void flushThreadFunc();
+  // 由 BackgroundWorker::urgent() 提前创建的下一个文件，先以临时名字打开
+  struct Preopened {
+    mutex mutex_;
+    unique_ptr<AppendFile> file;
+    bool cancelled = false;
+  };
+
+  string getLogFileName(const string &basename, time_t now);
+  void write(const char *data, size_t len);
+  void checkRoll();
+  void preopen();
+  unique_ptr<AppendFile> takePreopened(const string &filename);
+  void archive(const string &filename);
+
+  // 单线程模式下不加锁
+  std::unique_lock<mutex> lock() {
+    return threadSafe_ ? std::unique_lock<mutex>(mutex_)
+                       : std::unique_lock<mutex>();
+  }
 
 private:
   const string basename_;
   const int rollSize_;
-  const int flushInterval_;
+  const FileHeaderFunc header_;
+  const WriteBackend backend_;
+  const bool directIO_;
+  const bool threadSafe_;
+  const RollPeriod rollPeriod_;
+  const Compression compression_;
+  unique_ptr<StreamCompressor> compressor_; // 输出到 file_
+  const size_t maxFiles_;
+  const uint64_t maxTotalBytes_;
   mutex mutex_;
   unique_ptr<AppendFile> file_ GUARDED_BY(mutex_);
-  thread flushThread_;
-  atomic<bool> running_;
+  string filename_;     // 当前文件名
+  time_t nextRollTime_; // 下一个周期边界，0 表示不按时间回滚
+  const string preopenedName_;
+  std::shared_ptr<Preopened> preopened_;
+  TimerService::TimerId flushTimer_;
 };
 
-LogFile::Impl::Impl(const string &basename, int rollSize, int flushInterval)
-    : basename_(basename), rollSize_(rollSize), flushInterval_(flushInterval) {
+LogFile::Impl::Impl(const string &basename, int rollSize,
+                    const LogFileOptions &options)
+    : basename_(basename), rollSize_(rollSize), header_(options.header),
+      backend_(options.backend), directIO_(options.directIO),
+      threadSafe_(options.threadSafe), rollPeriod_(options.rollPeriod),
+      compression_(options.compression),
+      compressor_(options.streamCompression == Compression::kGzip
+                      ? new StreamCompressor(
+                            Z_BEST_SPEED,
+                            [this](const char *data, size_t len) {
+                              file_->append(data, len);
+                            })
+                      : nullptr),
+      maxFiles_(options.maxFiles),
+      maxTotalBytes_(options.maxTotalBytes), nextRollTime_(0),
+      preopenedName_(basename + ".next." + std::to_string(getpid()) + "." +
+                     std::to_string(g_nextFileId++) + ".log"),
+      preopened_(std::make_shared<Preopened>()), flushTimer_(0) {
   rollFile();
-  flushThread_ = thread([&]() {
-    running_ = true;
-    flushThreadFunc();
-  });
+  if (threadSafe_) {
+    flushTimer_ = TimerService::getInstance().add(options.flushInterval,
+                                                  [this]() { flush(); });
+  }
 }
 
 LogFile::Impl::~Impl() {
-  running_ = false;
-  flushThread_.join();
+  if (flushTimer_ != 0) {
+    TimerService::getInstance().remove(flushTimer_);
+  }
+  // compressor_ 先于 file_ 声明，析构前先结束最后一个 member
+  if (compressor_) {
+    compressor_->finish();
+  }
+  // 尚未用上的预创建文件直接删除，还未创建的由任务自行放弃
+  std::lock_guard<mutex> guard(preopened_->mutex_);
+  preopened_->cancelled = true;
+  if (preopened_->file) {
+    preopened_->file.reset();
+    unlink(preopenedName_.c_str());
+  }
 }
 
 void LogFile::Impl::append(const char *logline, size_t len) {
-  std::lock_guard<mutex> lock(mutex_);
-  file_->append(logline, len);
-  if (file_->writtenBytes() > rollSize_) {
+  auto guard = lock();
+  write(logline, len);
+  checkRoll();
+}
+
+void LogFile::Impl::submit(const char *data, size_t len) {
+  auto guard = lock();
+  if (compressor_) {
+    // 压缩输出本身就是一次拷贝，无需异步提交
+    compressor_->compress(data, len);
+  } else {
+    file_->submit(data, len);
+  }
+  checkRoll();
+}
+
+void LogFile::Impl::write(const char *data, size_t len) {
+  if (compressor_) {
+    compressor_->compress(data, len);
+  } else {
+    file_->append(data, len);
+  }
+}
+
+void LogFile::Impl::checkRoll() {
+  if (file_->writtenBytes() > static_cast<size_t>(rollSize_) ||
+      (nextRollTime_ != 0 && time(nullptr) >= nextRollTime_)) {
     rollFile();
   }
 }
 
+void LogFile::Impl::wait() {
+  auto guard = lock();
+  file_->wait();
+}
+
+bool LogFile::Impl::pending() {
+  auto guard = lock();
+  return file_->pending();
+}
+
 void LogFile::Impl::flush() {
-  std::lock_guard<mutex> lock(mutex_);
+  auto guard = lock();
+  if (compressor_) {
+    compressor_->finish();
+  }
   file_->flush();
+  // 没有新日志时也按时回滚
+  if (nextRollTime_ != 0 && time(nullptr) >= nextRollTime_) {
+    rollFile();
+  }
 }
 
 void LogFile::Impl::rollFile() {
-  string filename = getLogFileName(basename_);
-  file_.reset(new AppendFile(filename));
+  time_t now = time(nullptr);
+  string filename = getLogFileName(basename_, now);
+  string previous = std::move(filename_);
+  if (compressor_ && file_) {
+    compressor_->finish();
+  }
+  // 同一秒内回滚会打开同名文件，先关闭旧文件并等待其异步写入完成，
+  // 新文件才能从正确的偏移处续写
+  file_.reset();
+  file_ = takePreopened(filename);
+  if (!file_) {
+    file_.reset(new AppendFile(filename, backend_, directIO_, rollSize_));
+  }
+  filename_ = filename;
+  if (header_) {
+    string header = header_();
+    write(header.data(), header.size());
+  }
+
+  switch (rollPeriod_) {
+  case RollPeriod::kNone:
+    break;
+  case RollPeriod::kHourly:
+    nextRollTime_ = (now / 3600 + 1) * 3600;
+    break;
+  case RollPeriod::kDaily:
+    nextRollTime_ = (now / 86400 + 1) * 86400;
+    break;
+  }
+  preopen();
+  if (!previous.empty() && previous != filename_) {
+    archive(previous);
+  }
 }
 
-string LogFile::Impl::getLogFileName(const string &basename) {
+void LogFile::Impl::preopen() {
+  std::shared_ptr<Preopened> preopened = preopened_;
+  {
+    std::lock_guard<mutex> guard(preopened->mutex_);
+    if (preopened->file) {
+      return;
+    }
+  }
+  // 不与压缩、清理任务共用低优先级的线程，否则负载高时来不及创建，
+  // 回滚时只能在后端线程上同步打开文件
+  BackgroundWorker::urgent().post(
+      [preopened, name = preopenedName_, backend = backend_,
+       directIO = directIO_, rollSize = rollSize_]() {
+        {
+          std::lock_guard<mutex> guard(preopened->mutex_);
+          if (preopened->cancelled || preopened->file) {
+            return;
+          }
+        }
+        // 创建文件与预分配空间可能较慢，不持有锁
+        unique_ptr<AppendFile> file(
+            new AppendFile(name, backend, directIO, rollSize));
+        std::lock_guard<mutex> guard(preopened->mutex_);
+        if (preopened->cancelled) {
+          file.reset();
+          unlink(name.c_str());
+        } else {
+          preopened->file = std::move(file);
+        }
+      });
+}
+
+unique_ptr<AppendFile> LogFile::Impl::takePreopened(const string &filename) {
+  std::lock_guard<mutex> guard(preopened_->mutex_);
+  // 同名文件已存在时续写该文件，预创建的文件留待下次使用
+  if (!preopened_->file || access(filename.c_str(), F_OK) == 0 ||
+      rename(preopenedName_.c_str(), filename.c_str()) != 0) {
+    return nullptr;
+  }
+  return std::move(preopened_->file);
+}
+
+void LogFile::Impl::archive(const string &filename) {
+  if (compression_ == Compression::kNone && maxFiles_ == 0 &&
+      maxTotalBytes_ == 0) {
+    return;
+  }
+  BackgroundWorker::getInstance().post(
+      [filename, basename = basename_, newest = filename_,
+       compression = compression_, maxFiles = maxFiles_,
+       maxTotalBytes = maxTotalBytes_]() {
+        // 流式压缩的文件已经是 gzip 格式
+        if (compression == Compression::kGzip &&
+            filename.compare(filename.size() - 3, 3, ".gz") != 0) {
+          gzipFile(filename);
+        }
+        if (maxFiles > 0 || maxTotalBytes > 0) {
+          removeExpired(basename, newest, maxFiles, maxTotalBytes);
+        }
+      });
+}
+
+string LogFile::Impl::getLogFileName(const string &basename, time_t now) {
   string filename;
   filename.reserve(basename.size() + 64);
   // basename
   filename = basename;
   // time
   char timebuf[32] = {'\0'};
-  struct timeval tv;
-  gettimeofday(&tv, nullptr);
-  struct tm *timeInfo = gmtime(&tv.tv_sec);
+  struct tm tmBuf;
+  struct tm *timeInfo = gmtime_r(&now, &tmBuf);
   snprintf(timebuf, sizeof(timebuf), ".%4d%02d%02d-%02d%02d%02d(UTC).",
            timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday,
            timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec);
@@ -97,26 +389,30 @@ string LogFile::Impl::getLogFileName(const string &basename) {
   snprintf(pidbuf, sizeof pidbuf, ".%d", getpid());
   filename += pidbuf;
   // .log
-  filename += ".log";
+  filename += compressor_ ? ".log.gz" : ".log";
 
   return filename;
 }
 
-void LogFile::Impl::flushThreadFunc() {
-  while (running_) {
-    std::this_thread::sleep_for(std::chrono::seconds(flushInterval_));
-    flush();
-  }
-}
-
 LogFile::LogFile(const string &basename, int rollSize, int flushInterval)
-    : impl_(new Impl(basename, rollSize, flushInterval)) {}
+    : LogFile(basename, rollSize, LogFileOptions{flushInterval}) {}
+LogFile::LogFile(const string &basename, int rollSize,
+                 const LogFileOptions &options)
+    : impl_(new Impl(basename, rollSize, options)) {}
 LogFile::~LogFile() {}
 
 void LogFile::append(const char *logline, size_t len) {
   impl_->append(logline, len);
 }
 
+void LogFile::submit(const char *data, size_t len) {
+  impl_->submit(data, len);
+}
+
+void LogFile::wait() { impl_->wait(); }
+
+bool LogFile::pending() { return impl_->pending(); }
+
 void LogFile::flush() { impl_->flush(); }
 
 string getHostName() {
@@ -0,0 +1,33 @@
+#include "log_sink.h"
+
+namespace log {
+
+namespace {
+LogFileOptions singleThreaded(LogFileOptions options) {
+  // 只由 sink 线程访问，并由其定期 flush
+  options.threadSafe = false;
+  return options;
+}
+} // namespace
+
+FileSink::FileSink(const std::string &basename, int rollSize,
+                   LogFileOptions options)
+    : file_(std::make_unique<LogFile>(basename, rollSize,
+                                      singleThreaded(std::move(options)))) {}
+
+void FileSink::write(const char *logline, size_t len) {
+  file_->append(logline, len);
+}
+
+void FileSink::flush() { file_->flush(); }
+
+void StreamSink::write(const char *logline, size_t len) {
+  size_t n = fwrite_unlocked(logline, 1, len, stream_);
+  if (n != len) {
+    fprintf(stderr, "StreamSink::write() failed\n");
+  }
+}
+
+void StreamSink::flush() { fflush(stream_); }
+
+} // namespace log
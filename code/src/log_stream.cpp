@@ -1,60 +1,276 @@
 #include "log_stream.h"
+#include "escape.h"
 #include <algorithm>
+#include <charconv>
+#include <cstdlib>
 #include <cstring>
+#include <type_traits>
 
 namespace log {
 /*******************************整数类型转换字符串类型****************************************/
-const char digits[] = "9876543210123456789";
-const char *zero = digits + 9;
-static_assert(sizeof(digits) == 20, "wrong number of digits");
+const char kDigitPairs[] = "00010203040506070809"
+                           "10111213141516171819"
+                           "20212223242526272829"
+                           "30313233343536373839"
+                           "40414243444546474849"
+                           "50515253545556575859"
+                           "60616263646566676869"
+                           "70717273747576777879"
+                           "80818283848586878889"
+                           "90919293949596979899";
+static_assert(sizeof(kDigitPairs) == 201, "wrong number of digit pairs");
 
 const char digitsHex[] = "0123456789ABCDEF";
 static_assert(sizeof digitsHex == 17, "wrong number of digitsHex");
 
-// Efficient Integer to String Conversions, by Matthew Wilson.
+// 十进制位数，每轮比较 4 位，只需 1/4 的除法
+inline int countDigits(uint64_t n) {
+  int count = 1;
+  for (;;) {
+    if (n < 10) {
+      return count;
+    }
+    if (n < 100) {
+      return count + 1;
+    }
+    if (n < 1000) {
+      return count + 2;
+    }
+    if (n < 10000) {
+      return count + 3;
+    }
+    n /= 10000;
+    count += 4;
+  }
+}
+
+// 先计算位数，再借助两位数字表从右向左写入，无需翻转
 template <typename T> size_t convert(char buf[], T value) {
-  T i = value;
+  using U = typename std::make_unsigned<T>::type;
+  U u = static_cast<U>(value);
   char *p = buf;
-
-  do {
-    int lsd = static_cast<int>(i % 10);
-    i /= 10;
-    *p++ = zero[lsd];
-  } while (i != 0);
-
   if (value < 0) {
     *p++ = '-';
+    u = static_cast<U>(0) - u;
   }
-  *p = '\0';
-  std::reverse(buf, p);
 
-  return p - buf;
+  size_t len = countDigits(u);
+  char *q = p + len;
+  *q = '\0';
+  while (u >= 100) {
+    size_t pair = static_cast<size_t>(u % 100) * 2;
+    u /= 100;
+    q -= 2;
+    memcpy(q, kDigitPairs + pair, 2);
+  }
+  if (u >= 10) {
+    memcpy(q - 2, kDigitPairs + u * 2, 2);
+  } else {
+    *(q - 1) = static_cast<char>('0' + u);
+  }
+
+  return p + len - buf;
 }
 
+// 十六进制位数由最高有效位直接算出，按半字节从右向左写入
 size_t convertHex(char buf[], uintptr_t value) {
-  uintptr_t i = value;
-  char *p = buf;
-
+  size_t len = (sizeof(uintptr_t) * 8 - __builtin_clzll(value | 1) + 3) / 4;
+  char *p = buf + len;
+  *p = '\0';
   do {
-    int lsd = static_cast<int>(i % 16);
-    i /= 16;
-    *p++ = digitsHex[lsd];
-  } while (i != 0);
+    *--p = digitsHex[value & 0xF];
+    value >>= 4;
+  } while (value != 0);
 
-  *p = '\0';
-  std::reverse(buf, p);
+  return len;
+}
+
+// 转义后写入 buffer，并为之后的内容保留 reserve 字节，放不下时截断
+void appendEscapedTo(LogBuffer &buffer, const char *data, size_t len,
+                     size_t reserve) {
+  size_t room = buffer.room();
+  size_t cap = room > reserve ? std::min(room - reserve, len * 6) : 0;
+  char *p = cap > 0 ? buffer.ensure(cap) : nullptr;
+  size_t consumed = 0;
+  if (p != nullptr) {
+    buffer.add(escapeJson(data, len, p, cap, &consumed));
+  }
+  if (consumed < len) {
+    buffer.markTruncated();
+  }
+}
+
+/*******************************溢出区****************************************/
+// 每个线程保留几块溢出区: 缓冲区溢出时取走，reset() 时归还，
+// 同一线程之后的长日志可以直接复用，无需再次分配。正文与结构化字段
+// 可能同时溢出，嵌套输出的日志还会再占用一组，因此保留不止一块
+namespace {
+struct SpillArena {
+  static constexpr int kBlocks = 4;
+
+  struct Block {
+    char *data;
+    size_t capacity;
+  };
+  Block blocks[kBlocks] = {};
+
+  ~SpillArena() {
+    for (Block &block : blocks) {
+      free(block.data);
+      block = {nullptr, 0};
+    }
+  }
+
+  // 取走能容纳 capacity 字节的最小一块，没有时返回容量为 0 的空块
+  Block take(size_t capacity) {
+    Block *best = nullptr;
+    for (Block &block : blocks) {
+      if (block.capacity >= capacity &&
+          (best == nullptr || block.capacity < best->capacity)) {
+        best = &block;
+      }
+    }
+    if (best == nullptr) {
+      return {nullptr, 0};
+    }
+    Block taken = *best;
+    *best = {nullptr, 0};
+    return taken;
+  }
+
+  // 归还一块；已满时保留较大的几块，释放最小的一块
+  void give(Block block) {
+    Block *smallest = &blocks[0];
+    for (Block &slot : blocks) {
+      if (slot.capacity < smallest->capacity) {
+        smallest = &slot;
+      }
+    }
+    if (smallest->capacity < block.capacity) {
+      std::swap(*smallest, block);
+    }
+    free(block.data);
+  }
+};
+
+thread_local SpillArena t_spillArena;
+
+} // namespace
+
+/*********************************LogBuffer****************************************/
+void LogBuffer::appendSlow(const char *msg, size_t len) {
+  if (truncated_) {
+    return;
+  }
+  size_t n = std::min(len, limit_ - length());
+  if (length() + n > capacity_ && !grow(length() + n)) {
+    n = capacity_ - length();
+  }
+  if (n < len) {
+    // 不截断 UTF-8 多字节字符，JSON 格式的行因此仍是合法的 UTF-8
+    n = utf8Boundary(msg, n);
+  }
+  memcpy(cur_, msg, n);
+  cur_ += n;
+  if (n < len) {
+    markTruncated();
+  } else {
+    updateEnd();
+  }
+}
+
+char *LogBuffer::ensureSlow(size_t len) {
+  if (truncated_ || length() + len > limit_) {
+    return nullptr;
+  }
+  if (length() + len > capacity_ && !grow(length() + len)) {
+    return nullptr;
+  }
+  updateEnd();
+  return cur_;
+}
+
+bool LogBuffer::grow(size_t len) {
+  // 按倍数扩容，并为截断标记留出空间
+  size_t capacity = std::max(len, std::min(capacity_ * 2, limit_)) +
+                    kTruncatedMarkerLength;
+  size_t used = length();
+  char *data;
+  if (data_ != inline_) {
+    data = static_cast<char *>(realloc(data_, capacity));
+  } else {
+    SpillArena::Block block = t_spillArena.take(capacity);
+    if (block.data != nullptr) {
+      data = block.data;
+      capacity = block.capacity;
+    } else {
+      data = static_cast<char *>(malloc(capacity));
+    }
+    if (data != nullptr) {
+      memcpy(data, inline_, used);
+    }
+  }
+  if (data == nullptr) {
+    return false;
+  }
+  data_ = data;
+  cur_ = data + used;
+  capacity_ = capacity;
+  updateEnd();
+  return true;
+}
 
-  return p - buf;
+void LogBuffer::releaseSpill() {
+  t_spillArena.give({data_, capacity_});
+  data_ = inline_;
+  cur_ = inline_;
+  capacity_ = kInlineBuffer;
+  updateEnd();
+}
+
+void LogBuffer::truncate(size_t len) {
+  cur_ = data_ + len;
+  truncated_ = false;
+  updateEnd();
+}
+
+void LogBuffer::markTruncated() {
+  if (truncated_) {
+    return;
+  }
+  if (length() + kTruncatedMarkerLength > capacity_ &&
+      !grow(length() + kTruncatedMarkerLength)) {
+    cur_ = data_ + utf8Boundary(data_, capacity_ - kTruncatedMarkerLength);
+  }
+  memcpy(cur_, kTruncatedMarker, kTruncatedMarkerLength);
+  cur_ += kTruncatedMarkerLength;
+  truncated_ = true;
+  updateEnd();
+}
+
+void LogBuffer::extendLimit(size_t len) {
+  limit_ = std::max(limit_, length()) + len;
+  truncated_ = false;
+  updateEnd();
 }
 
 /*********************************LogStream****************************************/
-template <typename T> void LogStream::formatInteger(T v) {
-  if (buffer_.avail() >= kMaxNumericSize) {
-    size_t len = convert(buffer_.current(), v);
-    buffer_.add(len);
+template <typename Format>
+void LogStream::appendFormatted(Buffer &buffer, Format &&format) {
+  char *p = buffer.ensure(kMaxNumericSize);
+  if (p != nullptr) {
+    buffer.add(format(p));
+  } else {
+    // 接近上限时先写入临时缓冲区，由 append() 截断
+    char temp[kMaxNumericSize];
+    buffer.append(temp, format(temp));
   }
 }
 
+template <typename T> void LogStream::formatInteger(T v) {
+  appendFormatted(buffer_, [v](char *p) { return convert(p, v); });
+}
+
 LogStream &LogStream::operator<<(short v) {
   *this << static_cast<int>(v);
   return *this;
@@ -97,23 +313,140 @@ LogStream &LogStream::operator<<(unsigned long long v) {
 
 LogStream &LogStream::operator<<(const void *p) {
   uintptr_t v = reinterpret_cast<uintptr_t>(p);
-  if (buffer_.avail() >= kMaxNumericSize) {
-    char *buf = buffer_.current();
+  appendFormatted(buffer_, [v](char *buf) {
     buf[0] = '0';
     buf[1] = 'x';
-    size_t len = convertHex(buf + 2, v);
-    buffer_.add(len + 2);
-  }
+    return convertHex(buf + 2, v) + 2;
+  });
   return *this;
 }
 
-// FIXME: replace this with Grisu3 by Florian Loitsch.
+int LogStream::doublePrecision_ = 0;
+size_t LogStream::maxMessageSize_ = LogStream::kDefaultMaxMessageSize;
+
+void LogStream::setMaxMessageSize(size_t size) {
+  maxMessageSize_ = std::max(size, LogBuffer::kInlineBuffer);
+}
+
+void LogStream::setDoublePrecision(int precision) {
+  doublePrecision_ = std::max(0, std::min(precision, kMaxDoublePrecision));
+}
+
+// std::to_chars: 最短往返表示（Ryu 类算法），指定精度时等价于 "%.<precision>g"
 LogStream &LogStream::operator<<(double v) {
-  if (buffer_.avail() >= kMaxNumericSize) {
-    int len = snprintf(buffer_.current(), kMaxNumericSize, "%.12g", v);
-    buffer_.add(len);
-  }
+  appendFormatted(buffer_, [v](char *first) -> size_t {
+    char *last = first + kMaxNumericSize;
+    std::to_chars_result result =
+        doublePrecision_ == 0
+            ? std::to_chars(first, last, v)
+            : std::to_chars(first, last, v, std::chars_format::general,
+                            doublePrecision_);
+    return result.ptr - first;
+  });
   return *this;
 }
 
-} // namespace log
\ No newline at end of file
+/*******************************结构化字段****************************************/
+void LogStream::appendEscaped(const char *data, size_t len, size_t reserve) {
+  appendEscapedTo(buffer_, data, len, reserve);
+}
+
+void LogStream::escapeFrom(size_t offset) {
+  // 已截断时先去掉截断标记，转义后重新标记
+  bool truncated = buffer_.truncated();
+  size_t len = buffer_.length() - offset -
+               (truncated ? LogBuffer::kTruncatedMarkerLength : 0);
+  const char *begin = buffer_.data() + offset;
+  size_t pos = findJsonEscape(begin, len);
+  if (pos == len) {
+    return;
+  }
+  // 从第一个需要转义的字符开始，先移出再转义写回
+  thread_local string t_tail;
+  t_tail.assign(begin + pos, len - pos);
+  buffer_.truncate(offset + pos);
+  appendEscapedTo(buffer_, t_tail.data(), t_tail.size(), 0);
+  if (truncated) {
+    buffer_.markTruncated();
+  }
+}
+
+void LogStream::beginField(StringPiece key) {
+  if (format_ == LogFormat::kJson) {
+    // 截断标记只能出现在字符串中: 放不下一个完整的字段时丢弃其后的所有字段
+    if (fields_.room() < 2 + 1 + kJsonFieldReserve) {
+      fields_.seal();
+      return;
+    }
+    fields_.append(",\"", 2);
+    // 为引号、冒号与值保留空间
+    appendEscapedTo(fields_, key.data(), key.size(), kJsonFieldReserve);
+    if (fields_.truncated()) {
+      // 键已被截断，补全为 "键...(truncated)":null
+      fields_.extendLimit(6);
+      fields_.append("\":null", 6);
+      fields_.seal();
+      return;
+    }
+    fields_.append("\":", 2);
+  } else {
+    fields_.append(" ", 1);
+    fields_.append(key.data(), key.size());
+    fields_.append("=", 1);
+  }
+}
+
+void LogStream::fieldBool(bool v) {
+  if (v) {
+    fields_.append("true", 4);
+  } else {
+    fields_.append("false", 5);
+  }
+}
+
+void LogStream::fieldInteger(long long v) {
+  appendFormatted(fields_, [v](char *p) { return convert(p, v); });
+}
+
+void LogStream::fieldInteger(unsigned long long v) {
+  appendFormatted(fields_, [v](char *p) { return convert(p, v); });
+}
+
+void LogStream::fieldDouble(double v) {
+  // JSON 不能表示 NaN 与无穷大
+  if (format_ == LogFormat::kJson && !__builtin_isfinite(v)) {
+    fields_.append("null", 4);
+    return;
+  }
+  appendFormatted(fields_, [v](char *first) -> size_t {
+    std::to_chars_result result =
+        doublePrecision_ == 0
+            ? std::to_chars(first, first + kMaxNumericSize, v)
+            : std::to_chars(first, first + kMaxNumericSize, v,
+                            std::chars_format::general, doublePrecision_);
+    return result.ptr - first;
+  });
+}
+
+void LogStream::fieldString(StringPiece v) {
+  // 之前的字段已被截断，不再写入
+  if (fields_.truncated()) {
+    return;
+  }
+  if (format_ != LogFormat::kJson && !logfmtNeedsQuote(v.data(), v.size())) {
+    fields_.append(v.data(), v.size());
+    return;
+  }
+  fields_.append("\"", 1);
+  appendEscapedTo(fields_, v.data(), v.size(), 1);
+  if (fields_.truncated()) {
+    // 截断标记写在引号内，补上右引号后不再接受其它字段
+    fields_.extendLimit(1);
+    fields_.append("\"", 1);
+    fields_.seal();
+    return;
+  }
+  fields_.append("\"", 1);
+}
+
+} // namespace log
@@ -1,22 +1,71 @@
 #include "logger.h"
 #include "current_thread.h"
+#include "line_pattern.h"
 #include "log_stream.h"
+#include "tsc_clock.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <new>
 #include <sys/time.h>
 #include <thread>
 #include <time.h>
+#include <vector>
 
 namespace log {
 constexpr uint32_t NUM_LOG_LEVELS = 6U;
 const char *LogLevelName[NUM_LOG_LEVELS] = {
     "TRACE ", "DEBUG ", "INFO  ", "WARN  ", "ERROR ", "FATAL ",
 };
+// 结构化格式中不带填充空格的级别名
+const StringPiece kLevelNames[NUM_LOG_LEVELS] = {
+    "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL",
+};
+
+// 当前线程缓存的日期时间前缀，精确到秒
+thread_local time_t t_lastSecond = -1;
+thread_local char t_time[32] = {'\0'};
+thread_local int t_timeLength = 0;
+
+int formatLogTime(char *buf, time_t seconds, int microseconds) {
+  // 同一秒内 "YYYY-MM-DD HH:MM:SS." 不变，只在秒数变化时重新格式化
+  if (seconds != t_lastSecond) {
+    struct tm timeInfo;
+    gmtime_r(&seconds, &timeInfo);
+    t_timeLength =
+        snprintf(t_time, sizeof(t_time), "%4d-%02d-%02d %02d:%02d:%02d.",
+                 timeInfo.tm_year + 1900, timeInfo.tm_mon + 1,
+                 timeInfo.tm_mday, timeInfo.tm_hour, timeInfo.tm_min,
+                 timeInfo.tm_sec);
+    t_lastSecond = seconds;
+  }
+
+  // 缓存的前缀 + 6 位微秒 + "(UTC)"
+  memcpy(buf, t_time, t_timeLength);
+  char *p = buf + t_timeLength;
+  memcpy(p, kDigitPairs + microseconds / 10000 * 2, 2);
+  memcpy(p + 2, kDigitPairs + microseconds / 100 % 100 * 2, 2);
+  memcpy(p + 4, kDigitPairs + microseconds % 100 * 2, 2);
+  memcpy(p + 6, "(UTC)", 5);
+  return static_cast<int>(p + 11 - buf);
+}
+
 /********************************Logger::Impl*************************************/
 class Logger::Impl {
 public:
-  Impl(enum LogLevel level, const char *file, int line);
+  Impl(enum LogLevel level, SourceFile file, int line);
 
+  // 构造/析构当前线程复用的 Impl，每条日志无需堆内存分配
+  static Impl *acquire(enum LogLevel level, SourceFile file, int line);
+  static void release(Impl *impl);
+
+  void readClock();
   void formatTime();
+  LinePattern::Context context() const;
   void finish();
+  // 结构化格式（logfmt / JSON）的行首与行尾
+  void formatStructuredHeader();
+  void finishStructured();
 
   LogStream &stream() { return stream_; }
 
@@ -24,73 +73,372 @@ public:
   LogStream stream_;
   LogLevel level_; // 当前日志级别
   int line_;
-  const char *file_;
+  SourceFile file_;
+  LogFormat format_;
+  const LinePattern *pattern_; // 仅文本格式使用
+  size_t messageStart_; // 正文在缓冲区中的起始位置
 
   static LogLevel globalLevel_; // 日志库过滤日志级别
-  static OutputFunc outputFunc_;
-  static FlushFunc flushFunc_;
+  static LogFormat globalFormat_;
+
+private:
+  struct Slot;
+  static thread_local Slot slot_;
+  static thread_local int depth_; // 当前线程中尚未析构的 Logger 个数
 };
 
-Logger::Impl::Impl(enum LogLevel level, const char *file, int line)
-    : stream_(), level_(level), line_(line), file_(file) {
-  formatTime();
+struct Logger::Impl::Slot {
+  alignas(Impl) unsigned char data[sizeof(Impl)];
+};
+
+thread_local Logger::Impl::Slot Logger::Impl::slot_;
+thread_local int Logger::Impl::depth_ = 0;
+
+Logger::Impl *Logger::Impl::acquire(enum LogLevel level, SourceFile file,
+                                    int line) {
+  // 输出日志时又触发了日志输出（如 operator<< 内部打日志），槽位已被占用
+  if (depth_++ > 0) {
+    return new Impl(level, file, line);
+  }
+  return new (slot_.data) Impl(level, file, line);
+}
+
+void Logger::Impl::release(Impl *impl) {
+  --depth_;
+  if (reinterpret_cast<unsigned char *>(impl) == slot_.data) {
+    impl->~Impl();
+  } else {
+    delete impl;
+  }
+}
+
+Logger::Impl::Impl(enum LogLevel level, SourceFile file, int line)
+    : level_(level), line_(line), file_(file),
+      format_(globalFormat_) {
+  if (format_ != LogFormat::kText) {
+    formatStructuredHeader();
+    return;
+  }
+  pattern_ = &Logger::pattern();
+  if (pattern_->needsTime()) {
+    readClock();
+  } else {
+    currentTime_.tv_sec = 0;
+    currentTime_.tv_usec = 0;
+  }
   currentthread::tid();
-  stream_ << StringPiece(currentthread::tidString(),
-                         currentthread::tidStringLength());
-  stream_ << LogLevelName[static_cast<uint32_t>(level_)];
+  pattern_->formatPrefix(stream_, context());
+  messageStart_ = stream_.buffer().length();
 }
 
-void Logger::Impl::formatTime() {
-  gettimeofday(&currentTime_, NULL);
-  // 获取秒数和微秒数
-  time_t seconds = currentTime_.tv_sec;
-  suseconds_t microseconds = currentTime_.tv_usec;
+LinePattern::Context Logger::Impl::context() const {
+  // tidString 以空格结尾
+  return LinePattern::Context{currentTime_.tv_sec,
+                              static_cast<int>(currentTime_.tv_usec),
+                              currentthread::tidString(),
+                              currentthread::tidStringLength() - 1,
+                              level_,
+                              file_.data(),
+                              file_.size(),
+                              line_};
+}
 
-  // 使用秒数创建 struct timeval 结构体
-  struct timeval tv;
-  tv.tv_sec = seconds;
-  tv.tv_usec = microseconds;
+void Logger::Impl::formatStructuredHeader() {
+  stream_.setFieldFormat(format_);
+  bool json = format_ == LogFormat::kJson;
+  stream_ << (json ? "{\"time\":\"" : "time=\"");
+  formatTime();
+  stream_ << (json ? "\",\"tid\":" : "\" tid=") << currentthread::tid()
+          << (json ? ",\"level\":\"" : " level=")
+          << kLevelNames[static_cast<uint32_t>(level_)]
+          << (json ? "\",\"msg\":\"" : " msg=\"");
+  messageStart_ = stream_.buffer().length();
+}
 
-  // 使用 gmtime 函数将秒数转换为 struct tm 结构体（UTC 时间）
-  struct tm *timeInfo = gmtime(&seconds);
+void Logger::Impl::readClock() {
+  int64_t nanos = readLogClock();
+  currentTime_.tv_sec = static_cast<time_t>(nanos / 1000000000);
+  currentTime_.tv_usec = static_cast<suseconds_t>(nanos % 1000000000 / 1000);
+}
 
-  // 输出当前时间到 stream_中
-  char t_time[64] = {'\0'};
-  snprintf(t_time, sizeof(t_time), "%4d-%02d-%02d %02d:%02d:%02d.%06ld(UTC)",
-           timeInfo->tm_year + 1900, timeInfo->tm_mon + 1, timeInfo->tm_mday,
-           timeInfo->tm_hour, timeInfo->tm_min, timeInfo->tm_sec, microseconds);
-  stream_ << t_time;
+void Logger::Impl::formatTime() {
+  readClock();
+  char buf[64];
+  int len = formatLogTime(buf, currentTime_.tv_sec,
+                          static_cast<int>(currentTime_.tv_usec));
+  stream_.append(buf, len);
 }
 
 void Logger::Impl::finish() {
-  stream_ << " - " << file_ << ':' << line_ << '\n';
+  if (format_ != LogFormat::kText) {
+    finishStructured();
+    return;
+  }
+  stream_ << stream_.fields();
+  pattern_->formatSuffix(stream_, context());
+}
+
+void Logger::Impl::finishStructured() {
+  size_t fileLen = file_.size();
+  const LogStream::Buffer &fields = stream_.fields();
+  stream_.escapeFrom(messageStart_);
+  // 行尾不受正文长度上限限制，保证输出的始终是完整的一行
+  stream_.finishMessage(fields.length() + fileLen * 6 + 48);
+  if (format_ == LogFormat::kJson) {
+    stream_ << '"' << fields << ",\"file\":\"";
+    stream_.appendEscaped(file_.data(), fileLen, 32);
+    stream_ << "\",\"line\":" << line_ << "}\n";
+  } else {
+    stream_ << '"' << fields << " file=" << StringPiece(file_.data(), fileLen)
+            << " line=" << line_ << '\n';
+  }
 }
 
 /**********************************Logger*********************************/
-void defaultOutput(const char *msg, int len) { fwrite(msg, 1, len, stdout); }
+namespace {
+// 当前的输出端，发布后不再修改
+struct OutputTarget {
+  RawOutputFunc output;
+  void *outputContext;
+  void (*flush)(void *context);
+  void *flushContext;
+};
+
+void defaultOutput(void *, const char *msg, int len, LogLevel) {
+  fwrite(msg, 1, len, stdout);
+}
+
+void defaultFlush(void *) { fflush(stdout); }
+
+void callOutputFunc(void *context, const char *msg, int len, LogLevel) {
+  (*static_cast<OutputFunc *>(context))(msg, len);
+}
+
+void callLevelOutputFunc(void *context, const char *msg, int len,
+                         LogLevel level) {
+  (*static_cast<LevelOutputFunc *>(context))(msg, len, level);
+}
+
+void callFlushFunc(void *context) { (*static_cast<FlushFunc *>(context))(); }
+
+// 常量初始化，静态初始化期间输出的日志同样可用
+OutputTarget g_defaultTarget = {defaultOutput, nullptr, defaultFlush, nullptr};
+std::atomic<const OutputTarget *> g_target(&g_defaultTarget);
+std::mutex g_targetMutex;
+
+// 读者的危险指针: 调用输出端期间记录正在使用的 OutputTarget，
+// 被替换的输出端只有不再出现在任何槽中时才释放。槽在线程退出时归还，
+// 由此后的新线程复用，本身从不释放
+struct alignas(64) ReaderSlot {
+  std::atomic<const OutputTarget *> target{nullptr};
+  std::atomic<bool> used{true};
+  ReaderSlot *next = nullptr; // 加入链表后不再修改
+};
+
+std::atomic<ReaderSlot *> g_readers(nullptr);
+
+ReaderSlot *acquireSlot() {
+  for (ReaderSlot *slot = g_readers.load(std::memory_order_acquire);
+       slot != nullptr; slot = slot->next) {
+    bool used = false;
+    if (!slot->used.load(std::memory_order_relaxed) &&
+        slot->used.compare_exchange_strong(used, true)) {
+      return slot;
+    }
+  }
+  ReaderSlot *slot = new ReaderSlot;
+  slot->next = g_readers.load(std::memory_order_relaxed);
+  while (!g_readers.compare_exchange_weak(slot->next, slot,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+  return slot;
+}
+
+thread_local ReaderSlot *t_slot = nullptr;
+thread_local bool t_slotReleased = false;
+
+struct ReaderSlotOwner {
+  ~ReaderSlotOwner() {
+    t_slot->used.store(false, std::memory_order_release);
+    t_slot = nullptr;
+    t_slotReleased = true;
+  }
+};
 
-void defaultFlush() { fflush(stdout); }
+// 线程退出过程中槽已归还时返回 nullptr
+ReaderSlot *readerSlot() {
+  if (__builtin_expect(t_slot == nullptr, 0) && !t_slotReleased) {
+    t_slot = acquireSlot();
+    static thread_local ReaderSlotOwner owner;
+    (void)owner;
+  }
+  return t_slot;
+}
+
+// 以当前输出端调用 call: 先在槽中声明，再确认它仍是当前输出端
+template <typename Call> void withTarget(Call call) {
+  ReaderSlot *slot = readerSlot();
+  if (slot == nullptr) {
+    // 持有 g_targetMutex 时输出端不会被释放
+    std::lock_guard<std::mutex> lock(g_targetMutex);
+    call(g_target.load(std::memory_order_relaxed));
+    return;
+  }
+  // 输出函数中再次输出日志时沿用外层已声明的输出端
+  const OutputTarget *outer = slot->target.load(std::memory_order_relaxed);
+  if (outer != nullptr) {
+    call(outer);
+    return;
+  }
+  const OutputTarget *target = g_target.load(std::memory_order_acquire);
+  for (;;) {
+    slot->target.store(target, std::memory_order_seq_cst);
+    const OutputTarget *current = g_target.load(std::memory_order_seq_cst);
+    if (current == target) {
+      break;
+    }
+    target = current;
+  }
+  call(target);
+  slot->target.store(nullptr, std::memory_order_release);
+}
+
+// 由 setOutput()/setFlush() 创建、归 OutputTarget 所有的函数对象
+void destroyOutputContext(RawOutputFunc output, void *context) {
+  if (output == callOutputFunc) {
+    delete static_cast<OutputFunc *>(context);
+  } else if (output == callLevelOutputFunc) {
+    delete static_cast<LevelOutputFunc *>(context);
+  }
+}
+
+void destroyFlushContext(void (*flush)(void *), void *context) {
+  if (flush == callFlushFunc) {
+    delete static_cast<FlushFunc *>(context);
+  }
+}
+
+// 被替换的输出端，以及在替换时不再被新输出端引用的函数对象。
+// 新输出端都复制自当前输出端，函数对象一旦被替换便不会再被引用，
+// 但可能仍被更早的输出端引用，因此按替换的先后顺序释放
+struct RetiredTarget {
+  const OutputTarget *target;
+  bool ownsOutput;
+  bool ownsFlush;
+};
+
+std::vector<RetiredTarget> g_retired; // 由 g_targetMutex 保护
+
+bool pinned(const OutputTarget *target) {
+  for (ReaderSlot *slot = g_readers.load(std::memory_order_acquire);
+       slot != nullptr; slot = slot->next) {
+    if (slot->target.load(std::memory_order_seq_cst) == target) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void reclaimTargets() {
+  size_t n = 0;
+  for (; n < g_retired.size() && !pinned(g_retired[n].target); ++n) {
+    const RetiredTarget &retired = g_retired[n];
+    if (retired.ownsOutput) {
+      destroyOutputContext(retired.target->output,
+                           retired.target->outputContext);
+    }
+    if (retired.ownsFlush) {
+      destroyFlushContext(retired.target->flush, retired.target->flushContext);
+    }
+    if (retired.target != &g_defaultTarget) {
+      delete retired.target;
+    }
+  }
+  g_retired.erase(g_retired.begin(), g_retired.begin() + n);
+}
+
+// RCU 式更新: 复制当前输出端，修改后以一次原子写发布，读者无需加锁；
+// 旧的输出端可能仍在被其它线程调用，待没有读者持有后再释放
+template <typename Update> void updateTarget(Update update) {
+  std::lock_guard<std::mutex> lock(g_targetMutex);
+  const OutputTarget *old = g_target.load(std::memory_order_relaxed);
+  OutputTarget *target = new OutputTarget(*old);
+  update(target);
+  g_target.store(target, std::memory_order_seq_cst);
+  g_retired.push_back({old, old->outputContext != target->outputContext,
+                       old->flushContext != target->flushContext});
+  reclaimTargets();
+}
+} // namespace
+
+__attribute__((weak)) void logOutput(const char *msg, int len,
+                                     LogLevel level) {
+  withTarget([&](const OutputTarget *target) {
+    target->output(target->outputContext, msg, len, level);
+  });
+}
+
+__attribute__((weak)) void logFlush() {
+  withTarget([](const OutputTarget *target) {
+    target->flush(target->flushContext);
+  });
+}
 
 LogLevel Logger::Impl::globalLevel_ = LogLevel::INFO;
-OutputFunc Logger::Impl::outputFunc_ = defaultOutput;
-FlushFunc Logger::Impl::flushFunc_ = defaultFlush;
+LogFormat Logger::Impl::globalFormat_ = LogFormat::kText;
 
-Logger::Logger(const char *file, int line, LogLevel level)
-    : impl_(std::make_unique<Logger::Impl>(level, file, line)) {}
+namespace {
+clockid_t g_clockId = CLOCK_REALTIME;
+bool g_useTsc = false;
+// 调用线程当前日志的时间戳，见 takeRecordTime()
+thread_local int64_t t_recordTime = 0;
+} // namespace
+
+int64_t readLogClock() {
+  int64_t nanos;
+  if (g_useTsc) {
+    nanos = tscclock::now();
+  } else {
+    struct timespec ts;
+    clock_gettime(g_clockId, &ts);
+    nanos = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+  t_recordTime = nanos;
+  return nanos;
+}
+
+int64_t takeRecordTime() {
+  int64_t nanos = t_recordTime;
+  t_recordTime = 0;
+  return nanos;
+}
 
-Logger::Logger(const char *file, int line, LogLevel level, const char *func)
-    : impl_(std::make_unique<Logger::Impl>(level, file, line)) {
+SourceFile::SourceFile(const char *path) : data_(path) {
+  const char *slash = strrchr(path, '/');
+  if (slash != nullptr) {
+    data_ = slash + 1;
+  }
+  size_ = static_cast<int>(strlen(data_));
+}
+
+Logger::Logger(SourceFile file, int line, LogLevel level)
+    : impl_(Impl::acquire(level, file, line)) {}
+
+Logger::Logger(SourceFile file, int line, LogLevel level, const char *func)
+    : impl_(Impl::acquire(level, file, line)) {
   impl_->stream_ << func << ' ';
 }
 
 Logger::~Logger() {
   impl_->finish();
   const LogStream::Buffer &buf(impl_->stream().buffer());
-  Impl::outputFunc_(buf.data(), buf.length());
+  logOutput(buf.data(), buf.length(), impl_->level_);
   if (impl_->level_ == LogLevel::FATAL) {
-    Impl::flushFunc_();
+    logFlush();
     abort();
   }
+  Impl::release(impl_);
 }
 
 LogStream &Logger::stream() { return impl_->stream(); }
@@ -98,7 +446,58 @@ LogStream &Logger::stream() { return impl_->stream(); }
 void Logger::setLogLevel(LogLevel level) { Impl::globalLevel_ = level; }
 LogLevel Logger::getLogLevel() { return Impl::globalLevel_; }
 
-void Logger::setOutput(OutputFunc out) { Impl::outputFunc_ = out; }
-void Logger::setFlush(FlushFunc flush) { Impl::flushFunc_ = flush; }
+void Logger::setFormat(LogFormat format) { Impl::globalFormat_ = format; }
+
+namespace {
+// 首次使用时构造，静态初始化期间输出的日志同样可用
+LinePattern &globalPattern() {
+  static LinePattern pattern;
+  return pattern;
+}
+} // namespace
+
+bool Logger::setPattern(const char *pattern) {
+  return globalPattern().compile(pattern);
+}
+
+const LinePattern &Logger::pattern() { return globalPattern(); }
+
+void Logger::setOutput(OutputFunc out) {
+  OutputFunc *func = new OutputFunc(std::move(out));
+  updateTarget([func](OutputTarget *target) {
+    target->output = callOutputFunc;
+    target->outputContext = func;
+  });
+}
+
+void Logger::setOutput(LevelOutputFunc out) {
+  LevelOutputFunc *func = new LevelOutputFunc(std::move(out));
+  updateTarget([func](OutputTarget *target) {
+    target->output = callLevelOutputFunc;
+    target->outputContext = func;
+  });
+}
+
+void Logger::setOutput(RawOutputFunc out, void *context) {
+  updateTarget([out, context](OutputTarget *target) {
+    target->output = out;
+    target->outputContext = context;
+  });
+}
+
+void Logger::setFlush(FlushFunc flush) {
+  FlushFunc *func = new FlushFunc(std::move(flush));
+  updateTarget([func](OutputTarget *target) {
+    target->flush = callFlushFunc;
+    target->flushContext = func;
+  });
+}
+
+void Logger::setClockSource(ClockSource source) {
+  g_clockId = source == ClockSource::kRealtimeCoarse ? CLOCK_REALTIME_COARSE
+                                                     : CLOCK_REALTIME;
+  // 首次使用 TSC 时在此完成校准，而不是在某条日志中
+  g_useTsc = source == ClockSource::kTsc && tscclock::available();
+}
 
 } // namespace log
\ No newline at end of file
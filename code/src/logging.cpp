@@ -3,6 +3,13 @@
 namespace log {
 LogLevel getLogLevel() { return Logger::getLogLevel(); }
 void setLogLevel(LogLevel level) { Logger::setLogLevel(level); }
+void setFormat(LogFormat format) { Logger::setFormat(format); }
+bool setPattern(const char *pattern) { return Logger::setPattern(pattern); }
 void setOutput(OutputFunc func) { Logger::setOutput(func); }
+void setOutput(LevelOutputFunc func) { Logger::setOutput(func); }
+void setOutput(RawOutputFunc out, void *context) {
+  Logger::setOutput(out, context);
+}
 void setFlush(FlushFunc func) { Logger::setFlush(func); }
+void setClockSource(ClockSource source) { Logger::setClockSource(source); }
 } // namespace log
\ No newline at end of file
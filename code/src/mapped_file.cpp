@@ -0,0 +1,179 @@
+#include "mapped_file.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace log {
+
+namespace {
+constexpr size_t kMinSegmentSize = 1024 * 1024;
+
+size_t pageSize() {
+  static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+} // namespace
+
+class MappedFile::Impl {
+public:
+  Impl(const std::string &filename, size_t segmentSize);
+  ~Impl();
+
+  bool valid() const { return map_ != nullptr; }
+
+  void append(const char *logline, size_t len);
+
+  void flush();
+
+  size_t writtenBytes() const { return writtenBytes_; }
+
+private:
+  // 映射区剩余空间不足 len 时，预分配并映射下一段
+  bool reserve(size_t len);
+  void unmap();
+
+  const std::string filename_;
+  const size_t segmentSize_;
+  int fd_;
+  char *map_;          // 映射区起始地址，对应文件偏移 mapOffset_
+  off_t mapOffset_;    // 按页对齐
+  size_t mapLength_;
+  size_t pos_;         // 下一次写入在映射区中的位置
+  size_t synced_;      // 已 msync 的位置
+  size_t released_;    // 已 madvise 释放的位置
+  size_t writtenBytes_;
+};
+
+MappedFile::Impl::Impl(const std::string &filename, size_t segmentSize)
+    : filename_(filename),
+      segmentSize_(std::max(segmentSize, kMinSegmentSize)), fd_(-1),
+      map_(nullptr), mapOffset_(0), mapLength_(0), pos_(0), synced_(0),
+      released_(0), writtenBytes_(0) {
+  fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    fprintf(stderr, "MappedFile: open %s failed: %s\n", filename.c_str(),
+            strerror(errno));
+    return;
+  }
+  // 同一秒内回滚会打开同名文件，从已有内容之后续写
+  struct stat st;
+  off_t size = fstat(fd_, &st) == 0 ? st.st_size : 0;
+  mapOffset_ = size & ~static_cast<off_t>(pageSize() - 1);
+  pos_ = synced_ = released_ = size - mapOffset_;
+  reserve(0);
+}
+
+MappedFile::Impl::~Impl() {
+  if (fd_ < 0) {
+    return;
+  }
+  off_t end = mapOffset_ + pos_;
+  unmap();
+  // 去掉预分配但未写入的部分
+  if (ftruncate(fd_, end) != 0) {
+    fprintf(stderr, "MappedFile: ftruncate %s failed: %s\n", filename_.c_str(),
+            strerror(errno));
+  }
+  ::close(fd_);
+}
+
+void MappedFile::Impl::append(const char *logline, size_t len) {
+  if (!reserve(len)) {
+    fprintf(stderr, "MappedFile::append() failed\n");
+    return;
+  }
+  memcpy(map_ + pos_, logline, len);
+  pos_ += len;
+  writtenBytes_ += len;
+}
+
+void MappedFile::Impl::flush() {
+  if (map_ == nullptr) {
+    return;
+  }
+  const size_t page = pageSize();
+  // 上次 flush 已交给内核回写的整页不会再被修改，释放其映射
+  size_t releaseEnd = synced_ & ~(page - 1);
+  if (releaseEnd > released_) {
+    madvise(map_ + released_, releaseEnd - released_, MADV_DONTNEED);
+    released_ = releaseEnd;
+  }
+  if (pos_ > synced_) {
+    size_t begin = synced_ & ~(page - 1);
+    msync(map_ + begin, pos_ - begin, MS_ASYNC);
+    synced_ = pos_;
+  }
+}
+
+bool MappedFile::Impl::reserve(size_t len) {
+  if (map_ != nullptr && mapLength_ - pos_ >= len) {
+    return true;
+  }
+  const size_t page = pageSize();
+  // 新映射从当前写入位置所在的页开始
+  off_t offset = mapOffset_ + (pos_ & ~(page - 1));
+  size_t head = pos_ & (page - 1);
+  size_t length = std::max(segmentSize_, head + len);
+  length = (length + page - 1) & ~(page - 1);
+  if (map_ != nullptr) {
+    flush();
+    unmap();
+  }
+
+  // 预分配磁盘空间，只有文件系统不支持时才退化为扩展文件长度；
+  // 空间不足等错误下扩展出的稀疏文件会在写入映射时触发 SIGBUS
+  int err = posix_fallocate(fd_, offset, length);
+  if (err == EOPNOTSUPP || err == EINVAL) {
+    if (ftruncate(fd_, offset + length) != 0) {
+      fprintf(stderr, "MappedFile: ftruncate %s failed: %s\n",
+              filename_.c_str(), strerror(errno));
+      return false;
+    }
+  } else if (err != 0) {
+    fprintf(stderr, "MappedFile: preallocate %s failed: %s\n",
+            filename_.c_str(), strerror(err));
+    return false;
+  }
+  void *map =
+      mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, offset);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "MappedFile: mmap %s failed: %s\n", filename_.c_str(),
+            strerror(errno));
+    return false;
+  }
+  madvise(map, length, MADV_SEQUENTIAL);
+  map_ = static_cast<char *>(map);
+  mapOffset_ = offset;
+  mapLength_ = length;
+  pos_ = synced_ = released_ = head;
+  return mapLength_ - pos_ >= len;
+}
+
+void MappedFile::Impl::unmap() {
+  if (map_ != nullptr) {
+    msync(map_, pos_, MS_ASYNC);
+    munmap(map_, mapLength_);
+    map_ = nullptr;
+  }
+}
+
+MappedFile::MappedFile(const std::string &filename, size_t segmentSize)
+    : impl_(std::make_unique<Impl>(filename, segmentSize)) {}
+MappedFile::~MappedFile() {}
+
+bool MappedFile::valid() const { return impl_->valid(); }
+
+void MappedFile::append(const char *logline, size_t len) {
+  impl_->append(logline, len);
+}
+
+void MappedFile::flush() { impl_->flush(); }
+
+size_t MappedFile::writtenBytes() const { return impl_->writtenBytes(); }
+
+} // namespace log
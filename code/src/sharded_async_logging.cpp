@@ -0,0 +1,196 @@
+#include "sharded_async_logging.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace log {
+
+namespace {
+// 线程的序号，第一次输出时依次分配，使线程均匀地分布到各个分片
+std::atomic<size_t> g_nextThreadIndex(0);
+thread_local size_t t_threadIndex = SIZE_MAX;
+
+inline size_t threadIndex() {
+  if (__builtin_expect(t_threadIndex == SIZE_MAX, 0)) {
+    t_threadIndex = g_nextThreadIndex.fetch_add(1, std::memory_order_relaxed);
+  }
+  return t_threadIndex;
+}
+
+// FNV-1a
+inline uint64_t hashCategory(StringPiece category) {
+  uint64_t hash = 14695981039346656037ull;
+  for (int i = 0; i < category.size(); ++i) {
+    hash ^= static_cast<unsigned char>(category[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+} // namespace
+
+class ShardedAsyncLogging::Impl {
+public:
+  Impl(const string &basename, size_t shards, int rollSize,
+       int flushInterval) {
+    shards = std::max<size_t>(shards, 1);
+    shards_.reserve(shards);
+    for (size_t i = 0; i < shards; ++i) {
+      shards_.push_back(std::make_unique<AsyncLogging>(
+          basename + "." + std::to_string(i), rollSize, flushInterval));
+    }
+  }
+
+  // 对每个分片调用 func
+  template <typename Func> void forEach(Func &&func) {
+    for (auto &shard : shards_) {
+      func(*shard);
+    }
+  }
+
+  AsyncLogging &byThread() { return *shards_[threadIndex() % shards_.size()]; }
+
+  size_t shardOf(StringPiece category) const {
+    return hashCategory(category) % shards_.size();
+  }
+
+  std::vector<std::unique_ptr<AsyncLogging>> shards_;
+};
+
+ShardedAsyncLogging::ShardedAsyncLogging(const string &basename,
+                                         size_t shards, int rollSize,
+                                         int flushInterval)
+    : impl_(std::make_unique<Impl>(basename, shards, rollSize,
+                                   flushInterval)) {}
+ShardedAsyncLogging::~ShardedAsyncLogging() {}
+
+size_t ShardedAsyncLogging::shards() const { return impl_->shards_.size(); }
+
+AsyncLogging &ShardedAsyncLogging::shard(size_t index) {
+  return *impl_->shards_[index];
+}
+
+void ShardedAsyncLogging::setFrontEnd(AsyncLogging::FrontEnd frontEnd,
+                                      size_t ringSize) {
+  impl_->forEach(
+      [&](AsyncLogging &shard) { shard.setFrontEnd(frontEnd, ringSize); });
+}
+
+void ShardedAsyncLogging::setRecordFormat(AsyncLogging::RecordFormat format) {
+  impl_->forEach([&](AsyncLogging &shard) { shard.setRecordFormat(format); });
+}
+
+void ShardedAsyncLogging::setWriteBackend(WriteBackend backend,
+                                          bool directIO) {
+  impl_->forEach(
+      [&](AsyncLogging &shard) { shard.setWriteBackend(backend, directIO); });
+}
+
+void ShardedAsyncLogging::setRolling(RollPeriod period,
+                                     Compression compression,
+                                     size_t maxFiles, uint64_t maxTotalBytes) {
+  impl_->forEach([&](AsyncLogging &shard) {
+    shard.setRolling(period, compression, maxFiles, maxTotalBytes);
+  });
+}
+
+void ShardedAsyncLogging::setStreamCompression(Compression compression) {
+  impl_->forEach(
+      [&](AsyncLogging &shard) { shard.setStreamCompression(compression); });
+}
+
+void ShardedAsyncLogging::setBufferPool(size_t buffers, bool lockMemory,
+                                        bool hugePages) {
+  impl_->forEach([&](AsyncLogging &shard) {
+    shard.setBufferPool(buffers, lockMemory, hugePages);
+  });
+}
+
+void ShardedAsyncLogging::setOverloadPolicy(
+    AsyncLogging::OverloadPolicy policy, LogLevel keepLevel,
+    uint32_t sampleRate) {
+  impl_->forEach([&](AsyncLogging &shard) {
+    shard.setOverloadPolicy(policy, keepLevel, sampleRate);
+  });
+}
+
+void ShardedAsyncLogging::setStatsInterval(int seconds) {
+  impl_->forEach([&](AsyncLogging &shard) { shard.setStatsInterval(seconds); });
+}
+
+void ShardedAsyncLogging::setReorderWindow(int milliseconds) {
+  impl_->forEach(
+      [&](AsyncLogging &shard) { shard.setReorderWindow(milliseconds); });
+}
+
+void ShardedAsyncLogging::append(const char *logline, size_t len,
+                                 LogLevel level) {
+  impl_->byThread().append(logline, len, level);
+}
+
+void ShardedAsyncLogging::appendRecord(const char *record, size_t len,
+                                       LogLevel level) {
+  impl_->byThread().appendRecord(record, len, level);
+}
+
+void ShardedAsyncLogging::appendTo(StringPiece category, const char *logline,
+                                   size_t len, LogLevel level) {
+  impl_->shards_[impl_->shardOf(category)]->append(logline, len, level);
+}
+
+size_t ShardedAsyncLogging::shardOfThread() const {
+  return threadIndex() % impl_->shards_.size();
+}
+
+size_t ShardedAsyncLogging::shardOf(StringPiece category) const {
+  return impl_->shardOf(category);
+}
+
+AsyncLogging::DropStats ShardedAsyncLogging::dropStats() const {
+  AsyncLogging::DropStats total = {};
+  for (auto &shard : impl_->shards_) {
+    AsyncLogging::DropStats stats = shard->dropStats();
+    for (size_t i = 0; i < AsyncLogging::DropStats::kNumLevels; ++i) {
+      total.messages[i] += stats.messages[i];
+      total.bytes[i] += stats.bytes[i];
+    }
+  }
+  return total;
+}
+
+AsyncLogging::Stats ShardedAsyncLogging::stats() const {
+  AsyncLogging::Stats total = {};
+  for (auto &shard : impl_->shards_) {
+    AsyncLogging::Stats stats = shard->stats();
+    total.appendedMessages += stats.appendedMessages;
+    total.appendedBytes += stats.appendedBytes;
+    total.bufferSwaps += stats.bufferSwaps;
+    total.lockWaits += stats.lockWaits;
+    total.lockWaitNanos += stats.lockWaitNanos;
+    total.bufferWaits += stats.bufferWaits;
+    total.bufferWaitNanos += stats.bufferWaitNanos;
+    total.batches += stats.batches;
+    total.batchBytes += stats.batchBytes;
+    total.maxBatchBytes = std::max(total.maxBatchBytes, stats.maxBatchBytes);
+    total.writeNanos += stats.writeNanos;
+    total.maxWriteNanos = std::max(total.maxWriteNanos, stats.maxWriteNanos);
+    total.flushes += stats.flushes;
+    total.flushNanos += stats.flushNanos;
+    total.maxFlushNanos = std::max(total.maxFlushNanos, stats.maxFlushNanos);
+    for (size_t i = 0; i < AsyncLogging::DropStats::kNumLevels; ++i) {
+      total.drops.messages[i] += stats.drops.messages[i];
+      total.drops.bytes[i] += stats.drops.bytes[i];
+    }
+  }
+  return total;
+}
+
+void ShardedAsyncLogging::start() {
+  impl_->forEach([](AsyncLogging &shard) { shard.start(); });
+}
+
+void ShardedAsyncLogging::stop() {
+  impl_->forEach([](AsyncLogging &shard) { shard.stop(); });
+}
+
+} // namespace log
@@ -0,0 +1,276 @@
+#include "sink_dispatcher.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace log {
+
+namespace {
+constexpr size_t kChunkSize = 1024 * 1024;
+constexpr size_t kInitialEntries = 4096;
+
+// 日志行的共享存储，由 dispatcher 的当前引用与各 sink 队列中的条目共同持有
+struct Chunk {
+  Chunk() : refs(1), used(0) {}
+
+  std::atomic<uint32_t> refs;
+  size_t used;
+  char data[kChunkSize];
+};
+
+struct Entry {
+  Chunk *chunk;
+  const char *data;
+  size_t len;
+};
+} // namespace
+
+class SinkDispatcher::Impl {
+public:
+  explicit Impl(int flushInterval)
+      : flushInterval_(flushInterval), running_(false),
+        minLevel_(LogLevel::NUM_LOG_LEVELS), current_(nullptr) {}
+
+  ~Impl() {
+    if (running_) {
+      stop();
+    }
+  }
+
+  size_t addSink(std::shared_ptr<LogSink> sink, LogLevel level,
+                 size_t maxQueueBytes) {
+    auto queue = std::make_unique<SinkQueue>();
+    queue->sink = std::move(sink);
+    queue->level = level;
+    queue->maxBytes = maxQueueBytes;
+    // 队列中的条目使整块无法复用，按块数限制该 sink 占用的内存
+    queue->maxChunks = std::max<size_t>(maxQueueBytes / kChunkSize, 2);
+    queue->entries.reserve(kInitialEntries);
+    sinks_.push_back(std::move(queue));
+    minLevel_ = std::min(minLevel_, level);
+    return sinks_.size() - 1;
+  }
+
+  void append(const char *logline, size_t len, LogLevel level) {
+    if (level < minLevel_) {
+      return;
+    }
+    len = std::min(len, kChunkSize);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_ == nullptr) { // 尚未 start() 或已经 stop()
+      return;
+    }
+    if (current_->used + len > kChunkSize) {
+      release(current_, 1);
+      current_ = acquire();
+    }
+    Chunk *chunk = current_;
+    char *data = chunk->data + chunk->used;
+    memcpy(data, logline, len);
+    chunk->used += len;
+
+    for (auto &queue : sinks_) {
+      if (level >= queue->level) {
+        push(*queue, Entry{chunk, data, len});
+      }
+    }
+  }
+
+  uint64_t droppedMessages(size_t index) const {
+    return sinks_[index]->dropped.load(std::memory_order_relaxed);
+  }
+
+  void start() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      current_ = acquire();
+    }
+    running_ = true;
+    for (auto &queue : sinks_) {
+      SinkQueue *q = queue.get();
+      q->thread = std::thread([this, q]() { threadFunc(*q); });
+    }
+  }
+
+  void stop() {
+    // 先停止接收，stop() 期间写入的日志不会落在 sink 线程最后一次取走之后
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      release(current_, 1);
+      current_ = nullptr;
+    }
+    running_ = false;
+    for (auto &queue : sinks_) {
+      {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+      }
+      queue->cond.notify_one();
+    }
+    for (auto &queue : sinks_) {
+      queue->thread.join();
+    }
+  }
+
+private:
+  struct SinkQueue {
+    std::shared_ptr<LogSink> sink;
+    LogLevel level;
+    size_t maxBytes;
+    size_t maxChunks;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<Entry> entries; // 由 mutex 保护
+    size_t queuedBytes = 0;     // 由 mutex 保护
+    // 队列与正在写出的条目所引用的块数；同一块的条目在队列中总是相邻，
+    // 入队的条目换到新的块时加 1，sink 线程释放一段条目后减 1
+    size_t pinnedChunks = 0;    // 由 mutex 保护
+    Chunk *lastChunk = nullptr; // 由 mutex 保护，最近入队的条目所在的块
+
+    std::atomic<uint64_t> dropped{0};
+    std::thread thread;
+  };
+
+  void push(SinkQueue &queue, const Entry &entry) {
+    bool wakeup;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      // 积压的字节数或占用的块数超过上限时只丢弃这个 sink 的日志；
+      // 只接收少量日志的慢 sink 也不能使所有块都无法复用
+      bool newChunk = entry.chunk != queue.lastChunk;
+      if (queue.queuedBytes + entry.len > queue.maxBytes ||
+          (newChunk && queue.pinnedChunks >= queue.maxChunks)) {
+        queue.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (newChunk) {
+        ++queue.pinnedChunks;
+        queue.lastChunk = entry.chunk;
+      }
+      entry.chunk->refs.fetch_add(1, std::memory_order_relaxed);
+      queue.entries.push_back(entry);
+      queue.queuedBytes += entry.len;
+      wakeup = queue.entries.size() == 1;
+    }
+    if (wakeup) {
+      queue.cond.notify_one();
+    }
+  }
+
+  void threadFunc(SinkQueue &queue);
+
+  Chunk *acquire() {
+    std::lock_guard<std::mutex> lock(chunkMutex_);
+    if (freeChunks_.empty()) {
+      chunks_.push_back(std::make_unique<Chunk>());
+      return chunks_.back().get();
+    }
+    Chunk *chunk = freeChunks_.back();
+    freeChunks_.pop_back();
+    return chunk;
+  }
+
+  // 释放 chunk 的 n 个引用，最后一个引用释放后放回空闲列表
+  void release(Chunk *chunk, uint32_t n) {
+    if (chunk->refs.fetch_sub(n, std::memory_order_acq_rel) == n) {
+      chunk->refs.store(1, std::memory_order_relaxed);
+      chunk->used = 0;
+      std::lock_guard<std::mutex> lock(chunkMutex_);
+      freeChunks_.push_back(chunk);
+    }
+  }
+
+  const int flushInterval_;
+  std::atomic<bool> running_;
+  LogLevel minLevel_;
+  std::vector<std::unique_ptr<SinkQueue>> sinks_;
+
+  std::mutex mutex_;
+  Chunk *current_; // 由 mutex_ 保护
+
+  std::mutex chunkMutex_;
+  std::vector<std::unique_ptr<Chunk>> chunks_; // 由 chunkMutex_ 保护
+  std::vector<Chunk *> freeChunks_;            // 由 chunkMutex_ 保护
+};
+
+void SinkDispatcher::Impl::threadFunc(SinkQueue &queue) {
+  std::vector<Entry> entries;
+  entries.reserve(kInitialEntries);
+  uint64_t reported = 0;
+  bool running = true;
+  while (running) {
+    {
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      if (queue.entries.empty() && running_) {
+        queue.cond.wait_for(lock, std::chrono::seconds(flushInterval_));
+      }
+      // 在取走队列之前读取，保证 stop() 之前入队的日志都会被写出
+      running = running_;
+      entries.swap(queue.entries);
+      queue.queuedBytes = 0;
+      // 之后入队的条目即使仍在同一块中也另计一次，与下面按段释放对应
+      queue.lastChunk = nullptr;
+    }
+
+    uint64_t dropped = queue.dropped.load(std::memory_order_relaxed);
+    if (dropped != reported) {
+      char buf[256];
+      int len = snprintf(buf, sizeof buf,
+                         "Dropped %llu log messages for a slow sink\n",
+                         static_cast<unsigned long long>(dropped - reported));
+      fputs(buf, stderr);
+      queue.sink->write(buf, len);
+      reported = dropped;
+    }
+
+    for (const Entry &entry : entries) {
+      queue.sink->write(entry.data, entry.len);
+    }
+    // 同一块内连续的条目合并释放
+    size_t chunks = 0;
+    for (size_t i = 0; i < entries.size(); ++chunks) {
+      size_t j = i + 1;
+      while (j < entries.size() && entries[j].chunk == entries[i].chunk) {
+        ++j;
+      }
+      release(entries[i].chunk, static_cast<uint32_t>(j - i));
+      i = j;
+    }
+    entries.clear();
+    if (chunks > 0) {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.pinnedChunks -= chunks;
+    }
+    queue.sink->flush();
+  }
+}
+
+SinkDispatcher::SinkDispatcher(int flushInterval)
+    : impl_(std::make_unique<Impl>(flushInterval)) {}
+SinkDispatcher::~SinkDispatcher() {}
+
+size_t SinkDispatcher::addSink(std::shared_ptr<LogSink> sink, LogLevel level,
+                               size_t maxQueueBytes) {
+  return impl_->addSink(std::move(sink), level, maxQueueBytes);
+}
+
+void SinkDispatcher::append(const char *logline, size_t len, LogLevel level) {
+  impl_->append(logline, len, level);
+}
+
+uint64_t SinkDispatcher::droppedMessages(size_t index) const {
+  return impl_->droppedMessages(index);
+}
+
+void SinkDispatcher::start() { impl_->start(); }
+
+void SinkDispatcher::stop() { impl_->stop(); }
+
+} // namespace log
@@ -0,0 +1,112 @@
+#include "stream_compressor.h"
+#include <cstdio>
+#include <cstdlib>
+#include <zlib.h>
+
+namespace log {
+
+namespace {
+constexpr size_t kOutputBufferSize = 256 * 1024;
+// windowBits 加 16 表示输出 gzip 格式
+constexpr int kGzipWindowBits = 15 + 16;
+} // namespace
+
+class StreamCompressor::Impl {
+public:
+  Impl(int level, OutputFunc output);
+  ~Impl();
+
+  void compress(const char *data, size_t len);
+  void finish();
+
+  size_t inputBytes() const { return inputBytes_; }
+  size_t outputBytes() const { return outputBytes_; }
+
+private:
+  // 以 flush 方式驱动 deflate，输出缓冲区满时交给 output_
+  void deflateAll(int flush);
+
+  const OutputFunc output_;
+  z_stream stream_;
+  bool open_; // 当前 member 已有数据、尚未结束
+  size_t inputBytes_;
+  size_t outputBytes_;
+  unsigned char buffer_[kOutputBufferSize];
+};
+
+StreamCompressor::Impl::Impl(int level, OutputFunc output)
+    : output_(std::move(output)), open_(false), inputBytes_(0),
+      outputBytes_(0) {
+  stream_.zalloc = Z_NULL;
+  stream_.zfree = Z_NULL;
+  stream_.opaque = Z_NULL;
+  if (deflateInit2(&stream_, level, Z_DEFLATED, kGzipWindowBits, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    fprintf(stderr, "StreamCompressor: deflateInit2 failed\n");
+    abort();
+  }
+}
+
+StreamCompressor::Impl::~Impl() {
+  finish();
+  deflateEnd(&stream_);
+}
+
+void StreamCompressor::Impl::compress(const char *data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  stream_.avail_in = static_cast<uInt>(len);
+  deflateAll(Z_NO_FLUSH);
+  inputBytes_ += len;
+  open_ = true;
+}
+
+void StreamCompressor::Impl::finish() {
+  if (!open_) {
+    return;
+  }
+  stream_.next_in = Z_NULL;
+  stream_.avail_in = 0;
+  deflateAll(Z_FINISH);
+  // 下一次 compress() 开始新的 member
+  deflateReset(&stream_);
+  open_ = false;
+}
+
+void StreamCompressor::Impl::deflateAll(int flush) {
+  for (;;) {
+    stream_.next_out = buffer_;
+    stream_.avail_out = sizeof buffer_;
+    int ret = deflate(&stream_, flush);
+    size_t have = sizeof buffer_ - stream_.avail_out;
+    if (have > 0) {
+      output_(reinterpret_cast<const char *>(buffer_), have);
+      outputBytes_ += have;
+    }
+    if (ret == Z_STREAM_END || ret == Z_STREAM_ERROR) {
+      return;
+    }
+    // 输出缓冲区未被填满说明输入已全部处理
+    if (stream_.avail_out != 0 && flush != Z_FINISH) {
+      return;
+    }
+  }
+}
+
+StreamCompressor::StreamCompressor(int level, OutputFunc output)
+    : impl_(std::make_unique<Impl>(level, std::move(output))) {}
+StreamCompressor::~StreamCompressor() {}
+
+void StreamCompressor::compress(const char *data, size_t len) {
+  impl_->compress(data, len);
+}
+
+void StreamCompressor::finish() { impl_->finish(); }
+
+size_t StreamCompressor::inputBytes() const { return impl_->inputBytes(); }
+
+size_t StreamCompressor::outputBytes() const { return impl_->outputBytes(); }
+
+} // namespace log
@@ -0,0 +1,112 @@
+#include "timer_service.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace log {
+
+class TimerService::Impl {
+public:
+  Impl() : nextId_(1), running_(false), current_(0) {}
+  ~Impl();
+
+  TimerId add(int intervalSeconds, TimerFunc func);
+  void remove(TimerId id);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Timer {
+    TimerId id;
+    Clock::duration interval;
+    Clock::time_point deadline;
+    TimerFunc func;
+  };
+
+  void threadFunc();
+
+  std::mutex mutex_;
+  std::condition_variable cond_;     // 定时器变化或线程退出
+  std::condition_variable finished_; // 一次回调执行完毕
+  std::vector<Timer> timers_;        // 数量很少，线性查找即可
+  TimerId nextId_;
+  bool running_;
+  TimerId current_; // 正在执行的定时器，0 表示没有
+  std::thread thread_;
+};
+
+TimerService::Impl::~Impl() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    running_ = false;
+  }
+  cond_.notify_one();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+TimerService::TimerId TimerService::Impl::add(int intervalSeconds,
+                                              TimerFunc func) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  Clock::duration interval = std::chrono::seconds(std::max(intervalSeconds, 1));
+  TimerId id = nextId_++;
+  timers_.push_back({id, interval, Clock::now() + interval, std::move(func)});
+  if (!running_) {
+    running_ = true;
+    thread_ = std::thread([this]() { threadFunc(); });
+  }
+  cond_.notify_one();
+  return id;
+}
+
+void TimerService::Impl::remove(TimerId id) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  finished_.wait(lock, [this, id]() { return current_ != id; });
+  timers_.erase(std::remove_if(timers_.begin(), timers_.end(),
+                               [id](const Timer &t) { return t.id == id; }),
+                timers_.end());
+}
+
+void TimerService::Impl::threadFunc() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    auto due = std::min_element(timers_.begin(), timers_.end(),
+                                [](const Timer &a, const Timer &b) {
+                                  return a.deadline < b.deadline;
+                                });
+    if (due == timers_.end()) {
+      cond_.wait(lock);
+      continue;
+    }
+    if (Clock::now() < due->deadline) {
+      cond_.wait_until(lock, due->deadline);
+      continue;
+    }
+    // 解锁执行回调，remove() 会等待其结束
+    due->deadline = Clock::now() + due->interval;
+    current_ = due->id;
+    TimerFunc func = due->func;
+    lock.unlock();
+    func();
+    lock.lock();
+    current_ = 0;
+    finished_.notify_all();
+  }
+}
+
+SINGLETON_PATTERN_IMPLEMENT(TimerService)
+
+TimerService::TimerService() : impl_(std::make_unique<Impl>()) {}
+TimerService::~TimerService() {}
+
+TimerService::TimerId TimerService::add(int intervalSeconds, TimerFunc func) {
+  return impl_->add(intervalSeconds, std::move(func));
+}
+
+void TimerService::remove(TimerId id) { impl_->remove(id); }
+
+} // namespace log
@@ -0,0 +1,155 @@
+#include "tsc_clock.h"
+
+#include <algorithm>
+#include <atomic>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define LOG_HAVE_TSC 1
+#else
+#define LOG_HAVE_TSC 0
+#endif
+
+namespace log {
+
+namespace tscclock {
+
+namespace {
+
+constexpr int64_t kNanosPerSecond = 1000000000;
+constexpr int64_t kMaxStepBack = kNanosPerSecond / 1000;
+
+int64_t readNanos(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * kNanosPerSecond + ts.tv_nsec;
+}
+
+inline uint64_t rdtsc() {
+#if LOG_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// CPUID.80000007H:EDX[8]，TSC 频率不随调频与休眠状态变化
+bool invariantTsc() {
+#if LOG_HAVE_TSC
+  unsigned eax, ebx, ecx, edx;
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+         (edx & (1u << 8)) != 0;
+#else
+  return false;
+#endif
+}
+
+// 同时读取 TSC 与 clock，取前后两次 rdtsc 的中点；多次采样取间隔最小的一次。
+// 第一次采样总是写入结果，即使 rdtsc 回绕使间隔等于 UINT64_MAX
+void samplePair(clockid_t clock, uint64_t *tsc, int64_t *nanos) {
+  uint64_t best = 0;
+  for (int i = 0; i < 3; ++i) {
+    uint64_t before = rdtsc();
+    int64_t value = readNanos(clock);
+    uint64_t after = rdtsc();
+    if (i == 0 || after - before < best) {
+      best = after - before;
+      *tsc = before + (after - before) / 2;
+      *nanos = value;
+    }
+  }
+}
+
+struct Calibration {
+  bool available;
+  // 频率以 CLOCK_MONOTONIC 测量，不受 CLOCK_REALTIME 跳变的影响
+  uint64_t anchorTsc;
+  int64_t anchorNanos;
+  std::atomic<double> nanosPerTick;
+  uint64_t rebaseTicks; // 约 1 秒，超过后线程重新对齐
+};
+
+Calibration *calibrate() {
+  Calibration *c = new Calibration;
+  c->available = invariantTsc();
+  c->nanosPerTick = 0;
+  if (!c->available) {
+    return c;
+  }
+  samplePair(CLOCK_MONOTONIC, &c->anchorTsc, &c->anchorNanos);
+  uint64_t tsc;
+  int64_t nanos;
+  do {
+    samplePair(CLOCK_MONOTONIC, &tsc, &nanos);
+  } while (nanos - c->anchorNanos < kNanosPerSecond / 100);
+  if (tsc <= c->anchorTsc) {
+    c->available = false;
+    return c;
+  }
+  double nanosPerTick =
+      static_cast<double>(nanos - c->anchorNanos) / (tsc - c->anchorTsc);
+  c->nanosPerTick = nanosPerTick;
+  c->rebaseTicks = static_cast<uint64_t>(kNanosPerSecond / nanosPerTick);
+  return c;
+}
+
+Calibration &calibration() {
+  // 有意不释放，线程退出时仍可能读取时钟
+  static Calibration *calibration = calibrate();
+  return *calibration;
+}
+
+// 每个线程的对齐点，避免线程之间共享可写的状态
+struct ThreadBase {
+  uint64_t tsc;
+  int64_t nanos;
+  int64_t last; // 上一次返回的时间，保证单调
+};
+
+thread_local ThreadBase t_base = {0, 0, 0};
+
+void rebase(Calibration &c) {
+  uint64_t tsc;
+  int64_t monotonic;
+  samplePair(CLOCK_MONOTONIC, &tsc, &monotonic);
+  // 基线越长，测得的频率越准确
+  if (tsc - c.anchorTsc > c.rebaseTicks) {
+    c.nanosPerTick.store(static_cast<double>(monotonic - c.anchorNanos) /
+                             (tsc - c.anchorTsc),
+                         std::memory_order_relaxed);
+  }
+  samplePair(CLOCK_REALTIME, &t_base.tsc, &t_base.nanos);
+}
+
+} // namespace
+
+bool available() { return calibration().available; }
+
+int64_t now() {
+  Calibration &c = calibration();
+  if (!c.available) {
+    return readNanos(CLOCK_REALTIME);
+  }
+  uint64_t tsc = rdtsc();
+  if (__builtin_expect(tsc - t_base.tsc >= c.rebaseTicks, 0)) {
+    rebase(c);
+    tsc = std::max(rdtsc(), t_base.tsc);
+  }
+  int64_t nanos =
+      t_base.nanos + static_cast<int64_t>(
+                         (tsc - t_base.tsc) *
+                         c.nanosPerTick.load(std::memory_order_relaxed));
+  // 重新对齐时 CLOCK_REALTIME 可能略微落后于按旧频率推算的时间；
+  // 超过 kMaxStepBack 的回退视为系统时间被调整，跟随墙上时间
+  if (nanos < t_base.last && t_base.last - nanos < kMaxStepBack) {
+    nanos = t_base.last;
+  }
+  t_base.last = nanos;
+  return nanos;
+}
+
+} // namespace tscclock
+
+} // namespace log
@@ -1,11 +1,17 @@
 #include "async_logging.h"
-#include "logging.h"
+#include "binary_logging.h"
+#include "sharded_async_logging.h"
+#include "sink_dispatcher.h"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <stdio.h>
+#include <string.h>
 #include <sys/resource.h>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 using namespace log;
 using namespace std;
@@ -14,35 +20,132 @@ off_t kRollSize = 5 * 1000;
 
 AsyncLogging *g_asyncLog = NULL;
 // 设置异步，还需指定异步输出函数，非常不友好
-void asyncOutput(const char *msg, int len) { g_asyncLog->append(msg, len); }
+void asyncOutput(const char *msg, int len, LogLevel level) {
+  g_asyncLog->append(msg, len, level);
+}
+void asyncRecordOutput(const char *record, int len, LogLevel level) {
+  g_asyncLog->appendRecord(record, len, level);
+}
+
+ShardedAsyncLogging *g_shardedLog = NULL;
+void shardedOutput(const char *msg, int len, LogLevel level) {
+  g_shardedLog->append(msg, len, level);
+}
+void shardedRecordOutput(const char *record, int len, LogLevel level) {
+  g_shardedLog->appendRecord(record, len, level);
+}
+
+SinkDispatcher *g_dispatcher = NULL;
+void sinkOutput(const char *msg, int len, LogLevel level) {
+  g_dispatcher->append(msg, len, level);
+}
 
-void bench(bool longLog) {
-  setOutput(asyncOutput);
+void bench(bool longLog, int numThreads, bool binary, bool bindOutput) {
+  if (!bindOutput) {
+    setOutput(LevelOutputFunc(g_dispatcher    ? sinkOutput
+                              : g_shardedLog ? shardedOutput
+                                             : asyncOutput));
+  } else if (g_dispatcher) {
+    setOutput<&SinkDispatcher::append>(g_dispatcher);
+  } else if (g_shardedLog) {
+    setOutput<&ShardedAsyncLogging::append>(g_shardedLog);
+  } else {
+    setOutput<&AsyncLogging::append>(g_asyncLog);
+  }
+  if (binary) {
+    setBinaryOutput(g_shardedLog ? shardedRecordOutput : asyncRecordOutput);
+  }
 
-  int cnt = 0;
-  const int kBatch = 1000000;
+  const int kBatch = 1000000 / numThreads;
   string empty = " ";
   string longStr(3000, 'X');
   longStr += " ";
 
   for (int t = 0; t < 10; ++t) {
     clock_t start = clock();
+    auto wallStart = std::chrono::steady_clock::now();
 
-    for (int i = 0; i < kBatch; ++i) {
-      LOG_INFO << "Hello 0123456789"
-               << " abcdefghijklmnopqrstuvwxyz " << (longLog ? longStr : empty)
-               << cnt;
-      ++cnt;
+    // 每个线程输出 kBatch 条，总条数与单线程时保持一致
+    std::vector<std::thread> threads;
+    for (int n = 0; n < numThreads; ++n) {
+      threads.emplace_back([&]() {
+        for (int i = 0; i < kBatch; ++i) {
+          if (binary) {
+            LOG_FMT(INFO, "Hello 0123456789 abcdefghijklmnopqrstuvwxyz {}{}",
+                    longLog ? longStr : empty, i);
+          } else {
+            LOG_INFO << "Hello 0123456789"
+                     << " abcdefghijklmnopqrstuvwxyz "
+                     << (longLog ? longStr : empty) << i;
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
     }
     // 获取结束时间点
     clock_t end = clock();
+    auto wallEnd = std::chrono::steady_clock::now();
     // 计算处理器时间差
     double cpu_time_used = static_cast<double>(end - start) / CLOCKS_PER_SEC;
+    double wall_time_used =
+        std::chrono::duration<double>(wallEnd - wallStart).count();
     // 输出执行时间
-    std::cout << "函数执行时间: " << cpu_time_used << " 秒" << std::endl;
+    std::cout << "函数执行时间: " << cpu_time_used << " 秒, 墙上时间: "
+              << wall_time_used << " 秒" << std::endl;
   }
 }
 
+void printStats(const AsyncLogging::Stats &stats) {
+  auto average = [](uint64_t total, uint64_t count) {
+    return count ? total / count : 0;
+  };
+  std::cout << "appended " << stats.appendedMessages << " messages ("
+            << stats.appendedBytes << " bytes), " << stats.bufferSwaps
+            << " buffer swaps\n"
+            << "lock waits " << stats.lockWaits << " ("
+            << stats.lockWaitNanos / 1000 << " us), buffer waits "
+            << stats.bufferWaits << " (" << stats.bufferWaitNanos / 1000
+            << " us)\n"
+            << "batches " << stats.batches << " avg "
+            << average(stats.batchBytes, stats.batches) << " max "
+            << stats.maxBatchBytes << " bytes, write avg "
+            << average(stats.writeNanos, stats.batches) / 1000 << " max "
+            << stats.maxWriteNanos / 1000 << " us, flush avg "
+            << average(stats.flushNanos, stats.flushes) / 1000 << " max "
+            << stats.maxFlushNanos / 1000 << " us" << std::endl;
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-l] [-t threads] [-f shared|local] "
+          "[-r text|binary|binaryfile] [-p block|newest|oldest|level|sample] "
+          "[-w stdio|writev|uring|mmap] [-d] [-z] [-c] [-k files] "
+          "[-s sinks] [-o function|bind] [-m text|logfmt|json] "
+          "[-P pattern] [-n shards] [-S seconds] [-C realtime|coarse|tsc] "
+          "[-R ms]\n"
+          "  -l  输出 3000 字节的长日志\n"
+          "  -t  生产者线程数，默认 1\n"
+          "  -f  前端缓冲模式，默认 shared\n"
+          "  -r  记录格式，binary* 使用 LOG_FMT 延迟格式化，默认 text\n"
+          "  -p  过载策略，level/sample 保留 WARN 及以上级别，默认 newest\n"
+          "  -w  日志文件的写入方式，默认 stdio\n"
+          "  -d  以 O_DIRECT 写入，仅对 writev/uring 有效\n"
+          "  -z  回滚后以 gzip 压缩旧文件\n"
+          "  -c  写入时即流式 gzip 压缩\n"
+          "  -k  保留的已回滚文件个数，默认不限制\n"
+          "  -s  不使用 AsyncLogging，经 SinkDispatcher 分发到多个日志文件\n"
+          "  -o  输出端经 std::function 调用，或在编译期绑定，默认 function\n"
+          "  -m  日志行格式，默认 text\n"
+          "  -P  text 格式的行布局，见 line_pattern.h\n"
+          "  -n  分片数，各生产者线程按分片写入各自的日志文件\n"
+          "  -S  后端线程每隔 seconds 秒将运行统计写入日志文件\n"
+          "  -C  时间戳的时钟源，默认 realtime\n"
+          "  -R  local 前端按时间戳排序输出的窗口（毫秒）\n",
+          prog);
+}
+
 int main(int argc, char *argv[]) {
   {
     // set max virtual memory to 2GB.
@@ -53,14 +156,213 @@ int main(int argc, char *argv[]) {
 
   printf("pid = %d\n", getpid());
 
+  bool longLog = false;
+  int numThreads = 1;
+  AsyncLogging::FrontEnd frontEnd = AsyncLogging::FrontEnd::kShared;
+  AsyncLogging::RecordFormat format = AsyncLogging::RecordFormat::kText;
+  AsyncLogging::OverloadPolicy policy =
+      AsyncLogging::OverloadPolicy::kDropNewest;
+  WriteBackend backend = WriteBackend::kStdio;
+  bool directIO = false;
+  Compression compression = Compression::kNone;
+  Compression streamCompression = Compression::kNone;
+  size_t maxFiles = 0;
+  int numSinks = 0;
+  int numShards = 0;
+  int statsInterval = 0;
+  int reorderWindow = 0;
+  bool bindOutput = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "lt:f:r:p:w:dzck:s:o:m:P:n:S:C:R:")) != -1) {
+    switch (opt) {
+    case 'l':
+      longLog = true;
+      break;
+    case 't':
+      numThreads = std::max(1, atoi(optarg));
+      break;
+    case 'f':
+      if (strcmp(optarg, "local") == 0) {
+        frontEnd = AsyncLogging::FrontEnd::kThreadLocal;
+      } else if (strcmp(optarg, "shared") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'r':
+      if (strcmp(optarg, "binary") == 0) {
+        format = AsyncLogging::RecordFormat::kBinary;
+      } else if (strcmp(optarg, "binaryfile") == 0) {
+        format = AsyncLogging::RecordFormat::kBinaryFile;
+      } else if (strcmp(optarg, "text") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'p':
+      if (strcmp(optarg, "block") == 0) {
+        policy = AsyncLogging::OverloadPolicy::kBlock;
+      } else if (strcmp(optarg, "oldest") == 0) {
+        policy = AsyncLogging::OverloadPolicy::kDropOldest;
+      } else if (strcmp(optarg, "level") == 0) {
+        policy = AsyncLogging::OverloadPolicy::kDropByLevel;
+      } else if (strcmp(optarg, "sample") == 0) {
+        policy = AsyncLogging::OverloadPolicy::kSample;
+      } else if (strcmp(optarg, "newest") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'w':
+      if (strcmp(optarg, "writev") == 0) {
+        backend = WriteBackend::kWritev;
+      } else if (strcmp(optarg, "uring") == 0) {
+        backend = WriteBackend::kIoUring;
+      } else if (strcmp(optarg, "mmap") == 0) {
+        backend = WriteBackend::kMmap;
+      } else if (strcmp(optarg, "stdio") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'd':
+      directIO = true;
+      break;
+    case 'z':
+      compression = Compression::kGzip;
+      break;
+    case 'c':
+      streamCompression = Compression::kGzip;
+      break;
+    case 'k':
+      maxFiles = static_cast<size_t>(std::max(0, atoi(optarg)));
+      break;
+    case 's':
+      numSinks = std::max(1, atoi(optarg));
+      break;
+    case 'n':
+      numShards = std::max(1, atoi(optarg));
+      break;
+    case 'S':
+      statsInterval = std::max(0, atoi(optarg));
+      break;
+    case 'C':
+      if (strcmp(optarg, "coarse") == 0) {
+        setClockSource(ClockSource::kRealtimeCoarse);
+      } else if (strcmp(optarg, "tsc") == 0) {
+        setClockSource(ClockSource::kTsc);
+      } else if (strcmp(optarg, "realtime") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'R':
+      reorderWindow = std::max(0, atoi(optarg));
+      break;
+    case 'm':
+      if (strcmp(optarg, "logfmt") == 0) {
+        setFormat(LogFormat::kLogfmt);
+      } else if (strcmp(optarg, "json") == 0) {
+        setFormat(LogFormat::kJson);
+      } else if (strcmp(optarg, "text") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'P':
+      if (!setPattern(optarg)) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'o':
+      if (strcmp(optarg, "bind") == 0) {
+        bindOutput = true;
+      } else if (strcmp(optarg, "function") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
   char name[256] = {'\0'};
   strncpy(name, argv[0], sizeof name - 1);
+
+  if (numSinks > 0) {
+    // 每条日志只格式化、拷贝一次，由各个 sink 的线程分别写入自己的文件
+    SinkDispatcher dispatcher;
+    LogFileOptions options;
+    options.backend = backend;
+    options.directIO = directIO;
+    options.compression = compression;
+    options.streamCompression = streamCompression;
+    options.maxFiles = maxFiles;
+    for (int i = 0; i < numSinks; ++i) {
+      string basename = string(::basename(name)) + ".sink" + to_string(i);
+      dispatcher.addSink(
+          std::make_shared<FileSink>(basename, kRollSize, options));
+    }
+    dispatcher.start();
+    g_dispatcher = &dispatcher;
+
+    bench(longLog, numThreads, false, bindOutput);
+
+    dispatcher.stop();
+    for (int i = 0; i < numSinks; ++i) {
+      std::cout << "sink " << i << " dropped "
+                << dispatcher.droppedMessages(i) << " messages" << std::endl;
+    }
+    return 0;
+  }
+
+  if (numShards > 0) {
+    // 每个分片有独立的后端线程与日志文件，可用 log_merge 按时间合并
+    ShardedAsyncLogging log(::basename(name), numShards, kRollSize);
+    log.setFrontEnd(frontEnd);
+    log.setRecordFormat(format);
+    log.setOverloadPolicy(policy);
+    log.setWriteBackend(backend, directIO);
+    log.setRolling(RollPeriod::kNone, compression, maxFiles);
+    log.setStreamCompression(streamCompression);
+    log.setStatsInterval(statsInterval);
+    log.setReorderWindow(reorderWindow);
+    log.start();
+    g_shardedLog = &log;
+
+    bench(longLog, numThreads, format != AsyncLogging::RecordFormat::kText,
+          bindOutput);
+
+    log.stop();
+    printStats(log.stats());
+    AsyncLogging::DropStats drops = log.dropStats();
+    std::cout << "Done, " << numShards << " shards, dropped "
+              << drops.totalMessages() << " messages (" << drops.totalBytes()
+              << " bytes)" << std::endl;
+    return 0;
+  }
+
   AsyncLogging log(::basename(name), kRollSize);
+  log.setFrontEnd(frontEnd);
+  log.setRecordFormat(format);
+  log.setOverloadPolicy(policy);
+  log.setWriteBackend(backend, directIO);
+  log.setRolling(RollPeriod::kNone, compression, maxFiles);
+  log.setStreamCompression(streamCompression);
+  log.setStatsInterval(statsInterval);
+  log.setReorderWindow(reorderWindow);
   log.start();
   g_asyncLog = &log;
 
-  bool longLog = argc > 1;
-  bench(longLog);
+  bench(longLog, numThreads, format != AsyncLogging::RecordFormat::kText,
+        bindOutput);
 
-  std::cout << "Done" << std::endl;
+  log.stop();
+  printStats(log.stats());
+  AsyncLogging::DropStats drops = log.dropStats();
+  std::cout << "Done, dropped " << drops.totalMessages() << " messages ("
+            << drops.totalBytes() << " bytes)" << std::endl;
 }
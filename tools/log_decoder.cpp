@@ -0,0 +1,79 @@
+#include "binary_decoder.h"
+#include "logging.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <zlib.h>
+
+using namespace log;
+
+// 将 AsyncLogging::RecordFormat::kBinaryFile 写出的二进制日志还原为文本
+// 经 gzread 读取，流式压缩的 .log.gz 文件与未压缩的文件都可直接解码
+bool decodeFile(gzFile in, const char *name) {
+  // 每个文件都以完整的调用点定义开头，各文件独立解码
+  BinaryDecoder decoder(false);
+  std::vector<char> buf(4 * 1024 * 1024);
+  size_t pending = 0;
+  string text;
+
+  int n;
+  while ((n = gzread(in, buf.data() + pending,
+                     static_cast<unsigned>(buf.size() - pending))) > 0) {
+    pending += n;
+    text.clear();
+    size_t consumed = decoder.decode(buf.data(), pending, &text);
+    fwrite(text.data(), 1, text.size(), stdout);
+    memmove(buf.data(), buf.data() + consumed, pending - consumed);
+    pending -= consumed;
+    // 单条记录超过缓冲区大小
+    if (pending == buf.size()) {
+      buf.resize(buf.size() * 2);
+    }
+  }
+  if (n < 0) {
+    int err;
+    fprintf(stderr, "%s: %s\n", name, gzerror(in, &err));
+    return false;
+  }
+  if (pending > 0) {
+    fprintf(stderr, "%s: truncated record at end of file (%zu bytes)\n", name,
+            pending);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "p:")) != -1) {
+    // 与写日志的进程使用相同的行布局
+    if (opt != 'p' || !setPattern(optarg)) {
+      optind = argc + 1;
+      break;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr,
+            "usage: %s [-p pattern] <binary log file>... (- for stdin)\n",
+            argv[0]);
+    return 1;
+  }
+
+  bool ok = true;
+  for (int i = optind; i < argc; ++i) {
+    bool useStdin = strcmp(argv[i], "-") == 0;
+    gzFile in = useStdin ? gzdopen(dup(STDIN_FILENO), "rb")
+                         : gzopen(argv[i], "rb");
+    if (in == nullptr) {
+      perror(argv[i]);
+      ok = false;
+      continue;
+    }
+    ok = decodeFile(in, useStdin ? "stdin" : argv[i]) && ok;
+    gzclose(in);
+  }
+  return ok ? 0 : 1;
+}
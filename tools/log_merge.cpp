@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+#include <memory>
+#include <queue>
+#include <vector>
+#include <zlib.h>
+
+// 将 ShardedAsyncLogging 各分片（及其回滚后的文件）写出的文本日志按时间戳
+// 合并为一个有序的输出。每个输入文件内的日志已按时间排序，只需 k 路归并。
+// 时间戳取自行首的 "YYYY-MM-DD HH:MM:SS[.ffffff]"，logfmt 与 JSON 行取
+// time 字段；没有时间戳的行视为上一行的延续，随上一行一起输出。
+// 经 gzread 读取，.log.gz 文件与未压缩的文件都可直接合并；
+// kBinaryFile 格式的分片需先由 log_decoder 解码
+
+namespace {
+
+constexpr int64_t kNoTimestamp = INT64_MIN;
+
+// 1970-01-01 起的天数
+int64_t daysFromCivil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = static_cast<unsigned>(y - era * 400);
+  unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+bool parseDigits(const char *p, int count, int *value) {
+  *value = 0;
+  for (int i = 0; i < count; ++i) {
+    if (p[i] < '0' || p[i] > '9') {
+      return false;
+    }
+    *value = *value * 10 + (p[i] - '0');
+  }
+  return true;
+}
+
+// 返回微秒时间戳，行首没有时间戳时返回 kNoTimestamp
+int64_t parseTimestamp(const std::string &line) {
+  const char *p = line.c_str();
+  if (strncmp(p, "{\"time\":\"", 9) == 0) {
+    p += 9;
+  } else if (strncmp(p, "time=\"", 6) == 0) {
+    p += 6;
+  }
+  // YYYY-MM-DD HH:MM:SS
+  int year, month, day, hour, minute, second;
+  if (strlen(p) < 19 || p[4] != '-' || p[7] != '-' || p[10] != ' ' ||
+      p[13] != ':' || p[16] != ':' || !parseDigits(p, 4, &year) ||
+      !parseDigits(p + 5, 2, &month) || !parseDigits(p + 8, 2, &day) ||
+      !parseDigits(p + 11, 2, &hour) || !parseDigits(p + 14, 2, &minute) ||
+      !parseDigits(p + 17, 2, &second)) {
+    return kNoTimestamp;
+  }
+  int64_t seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 +
+                    minute * 60 + second;
+  // 小数部分按微秒对齐，如 %e 输出的毫秒
+  int64_t micros = 0;
+  p += 19;
+  if (*p == '.') {
+    int digits = 0;
+    for (++p; *p >= '0' && *p <= '9' && digits < 6; ++p, ++digits) {
+      micros = micros * 10 + (*p - '0');
+    }
+    for (; digits < 6; ++digits) {
+      micros *= 10;
+    }
+  }
+  return seconds * 1000000 + micros;
+}
+
+class Input {
+public:
+  Input(gzFile file, const char *name) : file_(file), name_(name) {
+    gzbuffer(file_, 256 * 1024);
+    eof_ = !readLine(&next_);
+  }
+  ~Input() { gzclose(file_); }
+
+  // 读取下一条日志（含延续行），没有更多日志时返回 false
+  bool next() {
+    if (eof_) {
+      return false;
+    }
+    record_.swap(next_);
+    timestamp_ = parseTimestamp(record_);
+    for (;;) {
+      if (!readLine(&next_)) {
+        eof_ = true;
+        break;
+      }
+      if (parseTimestamp(next_) != kNoTimestamp) {
+        break;
+      }
+      record_ += next_;
+    }
+    return true;
+  }
+
+  int64_t timestamp() const { return timestamp_; }
+  const std::string &record() const { return record_; }
+  bool failed() const { return failed_; }
+
+private:
+  bool readLine(std::string *line) {
+    line->clear();
+    char buf[4096];
+    while (gzgets(file_, buf, sizeof buf) != nullptr) {
+      *line += buf;
+      if (line->back() == '\n') {
+        return true;
+      }
+    }
+    int err;
+    const char *msg = gzerror(file_, &err);
+    if (err != Z_OK && err != Z_BUF_ERROR) {
+      fprintf(stderr, "%s: %s\n", name_, msg);
+      failed_ = true;
+    }
+    // 文件末尾缺少 '\n' 的行
+    if (!line->empty()) {
+      *line += '\n';
+      return true;
+    }
+    return false;
+  }
+
+  gzFile file_;
+  const char *name_;
+  std::string record_;
+  std::string next_;
+  int64_t timestamp_ = kNoTimestamp;
+  bool eof_ = false;
+  bool failed_ = false;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  const char *output = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:")) != -1) {
+    if (opt != 'o') {
+      optind = argc + 1;
+      break;
+    }
+    output = optarg;
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-o output] <log file>...\n", argv[0]);
+    return 1;
+  }
+
+  FILE *out = output ? fopen(output, "w") : stdout;
+  if (out == nullptr) {
+    perror(output);
+    return 1;
+  }
+
+  bool ok = true;
+  std::vector<std::unique_ptr<Input>> inputs;
+  for (int i = optind; i < argc; ++i) {
+    gzFile file = gzopen(argv[i], "rb");
+    if (file == nullptr) {
+      perror(argv[i]);
+      ok = false;
+      continue;
+    }
+    inputs.push_back(std::make_unique<Input>(file, argv[i]));
+  }
+
+  // 小顶堆: 时间戳相同时按输入文件的顺序输出
+  using Entry = std::pair<int64_t, size_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    if (inputs[i]->next()) {
+      heap.emplace(inputs[i]->timestamp(), i);
+    }
+  }
+  while (!heap.empty()) {
+    size_t i = heap.top().second;
+    heap.pop();
+    const std::string &record = inputs[i]->record();
+    fwrite(record.data(), 1, record.size(), out);
+    if (inputs[i]->next()) {
+      heap.emplace(inputs[i]->timestamp(), i);
+    }
+  }
+
+  for (auto &input : inputs) {
+    ok = ok && !input->failed();
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  return ok ? 0 : 1;
+}